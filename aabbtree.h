@@ -0,0 +1,228 @@
+#pragma once
+
+#include "broadphase.h"
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// Dynamic bounding volume tree. Leaves hold each body's rect grown by a
+// margin, so a body only gets reinserted once it leaves its fat rect, and
+// rotations keep the tree balanced as bodies come and go. Best for open
+// areas where bodies and long bullet sweeps go every which way.
+class AABBTree : public Broadphase{
+    static const int NONE = -1;
+
+    struct Node{
+        SDL_FRect box;
+        int parent, left, right; // left == NONE for leaves
+        int height; // 0 for leaves
+        uint32_t handle;
+    };
+
+    float margin;
+    std::vector<Node> nodes;
+    int root, freeList; // free nodes are chained through parent
+    std::unordered_map<uint32_t, int> leaves; // NONE while the rect is empty
+    mutable std::vector<int> stack;
+
+    static SDL_FRect merge(const SDL_FRect &a, const SDL_FRect &b){
+        const float x = std::min(a.x, b.x), y = std::min(a.y, b.y);
+        return SDL_FRect{x, y, std::max(a.x + a.w, b.x + b.w) - x, std::max(a.y + a.h, b.y + b.h) - y};
+    }
+    static float perimeter(const SDL_FRect &r){
+        return 2.0f * (r.w + r.h);
+    }
+    static bool contains(const SDL_FRect &outer, const SDL_FRect &inner){
+        return outer.x <= inner.x && outer.y <= inner.y &&
+               inner.x + inner.w <= outer.x + outer.w && inner.y + inner.h <= outer.y + outer.h;
+    }
+    bool isLeaf(int i) const { return nodes[i].left == NONE; }
+
+    int allocate(){
+        if(freeList == NONE){
+            nodes.push_back(Node{});
+            return static_cast<int>(nodes.size()) - 1;
+        }
+        const int i = freeList;
+        freeList = nodes[i].parent;
+        return i;
+    }
+    void release(int i){
+        nodes[i].parent = freeList;
+        freeList = i;
+    }
+
+    // Refits boxes and heights from i up to the root, rotating on the way
+    void refit(int i){
+        while(i != NONE){
+            i = balance(i);
+            Node &n = nodes[i];
+            n.height = 1 + std::max(nodes[n.left].height, nodes[n.right].height);
+            n.box = merge(nodes[n.left].box, nodes[n.right].box);
+            i = n.parent;
+        }
+    }
+
+    // Walks down to the sibling that grows the tree's total perimeter the
+    // least, and pairs the new leaf with it under a fresh parent
+    void insertLeaf(int leaf){
+        if(root == NONE){
+            root = leaf;
+            nodes[leaf].parent = NONE;
+            return;
+        }
+        const SDL_FRect box = nodes[leaf].box;
+        int i = root;
+        while(!isLeaf(i)){
+            const Node &n = nodes[i];
+            const float combined = perimeter(merge(n.box, box));
+            const float cost = 2.0f * combined;
+            const float inherited = 2.0f * (combined - perimeter(n.box));
+            const auto descend = [&](int child){
+                const float grown = perimeter(merge(box, nodes[child].box));
+                return (isLeaf(child) ? grown : grown - perimeter(nodes[child].box)) + inherited;
+            };
+            const float costLeft = descend(n.left), costRight = descend(n.right);
+            if(cost < costLeft && cost < costRight) break;
+            i = costLeft < costRight ? n.left : n.right;
+        }
+        const int sibling = i;
+        const int oldParent = nodes[sibling].parent;
+        const int parent = allocate();
+        nodes[parent] = Node{merge(box, nodes[sibling].box), oldParent, sibling, leaf, nodes[sibling].height + 1, 0};
+        if(oldParent == NONE) root = parent;
+        else if(nodes[oldParent].left == sibling) nodes[oldParent].left = parent;
+        else nodes[oldParent].right = parent;
+        nodes[sibling].parent = parent;
+        nodes[leaf].parent = parent;
+        refit(parent);
+    }
+
+    void removeLeaf(int leaf){
+        if(leaf == root){
+            root = NONE;
+            return;
+        }
+        const int parent = nodes[leaf].parent;
+        const int grandParent = nodes[parent].parent;
+        const int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+        release(parent);
+        if(grandParent == NONE){
+            root = sibling;
+            nodes[sibling].parent = NONE;
+            return;
+        }
+        if(nodes[grandParent].left == parent) nodes[grandParent].left = sibling;
+        else nodes[grandParent].right = sibling;
+        nodes[sibling].parent = grandParent;
+        refit(grandParent);
+    }
+
+    // If one child of a is two or more levels taller than the other, lift it
+    // into a's place. Returns the index now at a's position.
+    int balance(int a){
+        if(isLeaf(a) || nodes[a].height < 2) return a;
+        const int b = nodes[a].left, c = nodes[a].right;
+        const int diff = nodes[c].height - nodes[b].height;
+        if(diff > 1) return rotate(a, c, b, false);
+        if(diff < -1) return rotate(a, b, c, true);
+        return a;
+    }
+    // up is the taller child of a, other the shorter. up takes a's place and
+    // a keeps up's shorter child.
+    int rotate(int a, int up, int other, bool upIsLeft){
+        const int f = nodes[up].left, g = nodes[up].right;
+        nodes[up].left = a;
+        nodes[up].parent = nodes[a].parent;
+        nodes[a].parent = up;
+        const int p = nodes[up].parent;
+        if(p == NONE) root = up;
+        else if(nodes[p].left == a) nodes[p].left = up;
+        else nodes[p].right = up;
+        const int keep = nodes[f].height > nodes[g].height ? f : g;
+        const int give = keep == f ? g : f;
+        nodes[up].right = keep;
+        if(upIsLeft) nodes[a].left = give;
+        else nodes[a].right = give;
+        nodes[give].parent = a;
+        nodes[a].box = merge(nodes[other].box, nodes[give].box);
+        nodes[a].height = 1 + std::max(nodes[other].height, nodes[give].height);
+        nodes[up].box = merge(nodes[a].box, nodes[keep].box);
+        nodes[up].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+        return up;
+    }
+
+    int createLeaf(uint32_t handle, const SDL_FRect &rect){
+        const int leaf = allocate();
+        nodes[leaf] = Node{
+            SDL_FRect{rect.x - margin, rect.y - margin, rect.w + margin * 2, rect.h + margin * 2},
+            NONE, NONE, NONE, 0, handle
+        };
+        insertLeaf(leaf);
+        return leaf;
+    }
+public:
+    AABBTree(float margin) : margin(margin), root(NONE), freeList(NONE) {}
+
+    void clear() override {
+        nodes.clear();
+        leaves.clear();
+        root = freeList = NONE;
+    }
+
+    void insert(uint32_t handle, const SDL_FRect &rect) override {
+        if(leaves.count(handle)){
+            move(handle, rect);
+            return;
+        }
+        leaves[handle] = emptyRect(rect) ? NONE : createLeaf(handle, rect);
+    }
+
+    void remove(uint32_t handle) override {
+        auto it = leaves.find(handle);
+        if(it == leaves.end()) return;
+        if(it->second != NONE){
+            removeLeaf(it->second);
+            release(it->second);
+        }
+        leaves.erase(it);
+    }
+
+    void move(uint32_t handle, const SDL_FRect &rect) override {
+        auto it = leaves.find(handle);
+        if(it == leaves.end()){
+            insert(handle, rect);
+            return;
+        }
+        int &leaf = it->second;
+        if(leaf != NONE){
+            if(!emptyRect(rect) && contains(nodes[leaf].box, rect)) return;
+            removeLeaf(leaf);
+            release(leaf);
+            leaf = NONE;
+        }
+        if(!emptyRect(rect)) leaf = createLeaf(handle, rect);
+    }
+
+    // Reports every leaf whose fat rect touches rect
+    void query(const SDL_FRect &rect, std::vector<uint32_t> &out) const override {
+        out.clear();
+        if(emptyRect(rect) || root == NONE) return;
+        stack.clear();
+        stack.push_back(root);
+        while(!stack.empty()){
+            const Node &n = nodes[stack.back()];
+            stack.pop_back();
+            if(!rectsTouch(n.box, rect)) continue;
+            if(n.left == NONE){
+                out.push_back(n.handle);
+            }
+            else{
+                stack.push_back(n.left);
+                stack.push_back(n.right);
+            }
+        }
+        std::sort(out.begin(), out.end());
+    }
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+// Where one sprite sheet ended up in the atlas: its frames in a row at (x, y)
+// and the same frames mirrored one by one in the row right below.
+struct AtlasEntry{
+    int page;
+    int x, y;
+    int frameSize, frameCount;
+};
+
+// Packs the small sprite sheets (square frames, one row) into a few large
+// pages so they can all be drawn from one texture. Every sheet is stored
+// twice, as is and pre-flipped, so sprites facing left need no flip at draw
+// time. The original textures stay the keys everything else refers to.
+class TextureAtlas{
+public:
+    static const int PAGE_SIZE = 1024;
+    static const int MAX_FRAME_SIZE = 64; // taller images, i.e. backgrounds, stay on their own
+    static const int PADDING = 1; // keeps nearest sampling from picking up the neighbours
+private:
+    std::vector<SDL_Surface*> surfaces; // pages still being packed, until build()
+    std::vector<SDL_Texture*> pages;
+    std::unordered_map<SDL_Texture*, AtlasEntry> entries;
+    int shelfX, shelfY, shelfH; // packing cursor on the last page
+
+    // Shelf packing: fill a row left to right, start a new row below it,
+    // start a new page when the rows run out
+    bool place(int w, int h, int &page, int &x, int &y){
+        if(w > PAGE_SIZE || h > PAGE_SIZE) return false;
+        if(surfaces.empty() || shelfX + w > PAGE_SIZE){
+            shelfX = 0;
+            shelfY += shelfH;
+            shelfH = 0;
+        }
+        if(surfaces.empty() || shelfY + h > PAGE_SIZE){
+            SDL_Surface *surface = SDL_CreateSurface(PAGE_SIZE, PAGE_SIZE, SDL_PIXELFORMAT_RGBA32);
+            if(!surface) return false;
+            SDL_FillSurfaceRect(surface, nullptr, 0);
+            surfaces.push_back(surface);
+            shelfX = shelfY = shelfH = 0;
+        }
+        page = static_cast<int>(surfaces.size()) - 1;
+        x = shelfX;
+        y = shelfY;
+        shelfX += w + PADDING;
+        shelfH = SDL_max(shelfH, h + PADDING);
+        return true;
+    }
+public:
+    TextureAtlas() : shelfX(0), shelfY(0), shelfH(0) {}
+
+    // Copies the sheet the texture key was made from into the atlas. Returns
+    // false if it doesn't go in, in which case key is drawn by itself.
+    bool add(SDL_Texture *key, SDL_Surface *surface){
+        if(!key || !surface || surface->h <= 0 || surface->h > MAX_FRAME_SIZE) return false;
+        SDL_Surface *rgba = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_RGBA32);
+        if(!rgba) return false;
+        const int size = rgba->h, count = rgba->w / rgba->h;
+        AtlasEntry entry{0, 0, 0, size, count};
+        if(count == 0 || !place(count * size, size * 2 + PADDING, entry.page, entry.x, entry.y)){
+            SDL_DestroySurface(rgba);
+            return false;
+        }
+        SDL_Surface *page = surfaces[entry.page];
+        for(int row = 0; row < size; row++){
+            const uint32_t *src = reinterpret_cast<const uint32_t*>(static_cast<const Uint8*>(rgba->pixels) + row * rgba->pitch);
+            uint32_t *dst = reinterpret_cast<uint32_t*>(static_cast<Uint8*>(page->pixels) + (entry.y + row) * page->pitch) + entry.x;
+            uint32_t *flipped = reinterpret_cast<uint32_t*>(static_cast<Uint8*>(page->pixels) + (entry.y + size + PADDING + row) * page->pitch) + entry.x;
+            for(int f = 0; f < count; f++){
+                for(int col = 0; col < size; col++){
+                    dst[f * size + col] = src[f * size + col];
+                    flipped[f * size + col] = src[f * size + size - 1 - col];
+                }
+            }
+        }
+        SDL_DestroySurface(rgba);
+        entries[key] = entry;
+        return true;
+    }
+
+    // Uploads the packed pages. Nothing can be added afterwards.
+    void build(SDL_Renderer *renderer){
+        for(SDL_Surface *surface : surfaces){
+            SDL_Texture *tex = SDL_CreateTextureFromSurface(renderer, surface);
+            SDL_SetTextureScaleMode(tex, SDL_SCALEMODE_NEAREST);
+            pages.push_back(tex);
+            SDL_DestroySurface(surface);
+        }
+        surfaces.clear();
+    }
+
+    void unload(){
+        for(SDL_Texture *tex : pages){
+            SDL_DestroyTexture(tex);
+        }
+        pages.clear();
+        entries.clear();
+    }
+
+    const AtlasEntry *find(SDL_Texture *key) const {
+        auto it = entries.find(key);
+        return it == entries.end() ? nullptr : &it->second;
+    }
+    SDL_Texture *page(int idx) const { return pages[idx]; }
+
+    SDL_FRect frameRect(const AtlasEntry &entry, int frame, bool flipped) const {
+        frame = SDL_clamp(frame, 0, entry.frameCount - 1);
+        return SDL_FRect{
+            .x = static_cast<float>(entry.x + frame * entry.frameSize),
+            .y = static_cast<float>(entry.y + (flipped ? entry.frameSize + PADDING : 0)),
+            .w = static_cast<float>(entry.frameSize),
+            .h = static_cast<float>(entry.frameSize)
+        };
+    }
+};
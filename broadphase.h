@@ -0,0 +1,32 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <vector>
+#include <cstdint>
+
+// Broadphase: bodies are opaque 32-bit handles with a bounding rect. A query
+// answers "who might touch this rect" with a superset of the bodies whose
+// rect touches it; the caller still does the exact test. Results come back
+// sorted and unique, so the game visits bodies in handle order whichever
+// implementation is in use. Rects with a negative size are tracked but never
+// reported.
+class Broadphase{
+public:
+    virtual ~Broadphase() = default;
+    virtual void clear() = 0;
+    virtual void insert(uint32_t handle, const SDL_FRect &rect) = 0;
+    virtual void remove(uint32_t handle) = 0;
+    virtual void move(uint32_t handle, const SDL_FRect &rect) = 0;
+    virtual void query(const SDL_FRect &rect, std::vector<uint32_t> &out) const = 0;
+};
+
+inline bool emptyRect(const SDL_FRect &rect){
+    return rect.w < 0.0f || rect.h < 0.0f;
+}
+
+// Same answer as SDL_GetRectIntersectionFloat for two non-empty rects, edges
+// touching included
+inline bool rectsTouch(const SDL_FRect &a, const SDL_FRect &b){
+    return SDL_max(a.x, b.x) <= SDL_min(a.x + a.w, b.x + b.w) &&
+           SDL_max(a.y, b.y) <= SDL_min(a.y + a.h, b.y + b.h);
+}
@@ -0,0 +1,159 @@
+// Replays a broadphase workload against every implementation and reports how
+// long each takes. Record a scene by running the game with
+// --record-scene=<file>, then run broadphase_bench <file>. Without a scene it
+// falls back to two synthetic ones: a long corridor and a crowded arena.
+#include <SDL3/SDL.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include "broadphases.h"
+
+const float GRID_CELL_SIZE = 64.0f;
+const int REPLAYS = 20;
+
+struct Op{
+    char kind; // c, i, r, m or q, as written by RecordingBroadphase
+    uint32_t handle;
+    SDL_FRect rect;
+};
+
+struct Scene{
+    std::string name;
+    std::vector<Op> ops;
+};
+
+bool loadScene(const char *path, Scene &scene){
+    size_t size;
+    char *data = static_cast<char*>(SDL_LoadFile(path, &size));
+    if(!data) return false;
+    scene.name = path;
+    for(char *line = data; line < data + size; ){
+        char *end = SDL_strchr(line, '\n');
+        if(end) *end = '\0';
+        Op op{line[0], 0, SDL_FRect{0}};
+        switch(op.kind){
+            case 'c':
+                scene.ops.push_back(op);
+                break;
+            case 'r':
+                if(SDL_sscanf(line + 1, "%u", &op.handle) == 1) scene.ops.push_back(op);
+                break;
+            case 'i':
+            case 'm':
+                if(SDL_sscanf(line + 1, "%u %f %f %f %f", &op.handle, &op.rect.x, &op.rect.y, &op.rect.w, &op.rect.h) == 5){
+                    scene.ops.push_back(op);
+                }
+                break;
+            case 'q':
+                if(SDL_sscanf(line + 1, "%f %f %f %f", &op.rect.x, &op.rect.y, &op.rect.w, &op.rect.h) == 4){
+                    scene.ops.push_back(op);
+                }
+                break;
+        }
+        line = end ? end + 1 : data + size;
+    }
+    SDL_free(data);
+    return !scene.ops.empty();
+}
+
+// Characters walking back and forth and querying around themselves, the way
+// the contact pass does every tick
+Scene makeScene(const std::string &name, int bodies, float width, float height, int bullets){
+    Scene scene{name, {}};
+    const int TICKS = 600;
+    const float W = 10.0f, H = 26.0f, BULLET = 8.0f;
+    std::vector<SDL_FRect> rects(bodies);
+    std::vector<float> vel(bodies);
+    scene.ops.push_back(Op{'c', 0, SDL_FRect{0}});
+    for(int i = 0; i < bodies; i++){
+        rects[i] = SDL_FRect{SDL_randf() * width, SDL_randf() * (height - H), W, H};
+        vel[i] = SDL_randf() * 2.0f - 1.0f;
+        scene.ops.push_back(Op{'i', static_cast<uint32_t>(i), rects[i]});
+    }
+    for(int t = 0; t < TICKS; t++){
+        for(int i = 0; i < bodies; i++){
+            rects[i].x += vel[i];
+            if(rects[i].x < 0 || rects[i].x > width) vel[i] = -vel[i];
+            scene.ops.push_back(Op{'m', static_cast<uint32_t>(i), rects[i]});
+        }
+        for(int i = 0; i < bodies; i++){
+            const SDL_FRect reach{rects[i].x - W, rects[i].y - H, W * 3, H * 3 + 1};
+            scene.ops.push_back(Op{'q', 0, reach});
+        }
+        // Fast bullets sweep their whole path for the tick
+        for(int i = 0; i < bullets; i++){
+            const SDL_FRect path{SDL_randf() * width, SDL_randf() * height, BULLET + 600.0f / 120.0f, BULLET};
+            scene.ops.push_back(Op{'q', 0, path});
+        }
+    }
+    return scene;
+}
+
+// One untimed pass counting the query results that really touch, so a
+// backend that misses bodies shows up as a different checksum
+uint64_t checksum(Broadphase &broadphase, const Scene &scene){
+    std::unordered_map<uint32_t, SDL_FRect> rects;
+    std::vector<uint32_t> out;
+    uint64_t sum = 0;
+    for(const Op &op : scene.ops){
+        switch(op.kind){
+            case 'c': broadphase.clear(); rects.clear(); break;
+            case 'i': broadphase.insert(op.handle, op.rect); rects[op.handle] = op.rect; break;
+            case 'm': broadphase.move(op.handle, op.rect); rects[op.handle] = op.rect; break;
+            case 'r': broadphase.remove(op.handle); rects.erase(op.handle); break;
+            case 'q':
+                broadphase.query(op.rect, out);
+                for(uint32_t handle : out){
+                    if(rectsTouch(rects[handle], op.rect)) sum = sum * 31 + handle + 1;
+                }
+                break;
+        }
+    }
+    return sum;
+}
+
+double replay(Broadphase &broadphase, const Scene &scene){
+    std::vector<uint32_t> out;
+    const uint64_t start = SDL_GetPerformanceCounter();
+    for(int r = 0; r < REPLAYS; r++){
+        for(const Op &op : scene.ops){
+            switch(op.kind){
+                case 'c': broadphase.clear(); break;
+                case 'i': broadphase.insert(op.handle, op.rect); break;
+                case 'r': broadphase.remove(op.handle); break;
+                case 'm': broadphase.move(op.handle, op.rect); break;
+                case 'q': broadphase.query(op.rect, out); break;
+            }
+        }
+        broadphase.clear();
+    }
+    const uint64_t ticks = SDL_GetPerformanceCounter() - start;
+    return static_cast<double>(ticks) * 1000.0 / SDL_GetPerformanceFrequency() / REPLAYS;
+}
+
+int main(int argc, char* argv[]){
+    std::vector<Scene> scenes;
+    if(argc > 1){
+        Scene scene;
+        if(loadScene(argv[1], scene)) scenes.push_back(scene);
+        else SDL_Log("Couldn't load scene %s, using the synthetic ones", argv[1]);
+    }
+    if(scenes.empty()){
+        SDL_srand(1);
+        scenes.push_back(makeScene("corridor", 400, 50 * 320.0f, 160.0f, 4));
+        scenes.push_back(makeScene("arena", 400, 640.0f, 640.0f, 200));
+    }
+    const char *names[] = {"hash", "sap", "tree"};
+    for(const Scene &scene : scenes){
+        SDL_Log("%s: %d ops", scene.name.c_str(), static_cast<int>(scene.ops.size()));
+        for(const char *name : names){
+            std::unique_ptr<Broadphase> broadphase = makeBroadphase(name, GRID_CELL_SIZE);
+            const uint64_t sum = checksum(*broadphase, scene);
+            broadphase->clear();
+            const double ms = replay(*broadphase, scene);
+            SDL_Log("  %-5s %9.3f ms per replay  checksum %016llx", name, ms, static_cast<unsigned long long>(sum));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "broadphase.h"
+#include "spatialhash.h"
+#include "sweepandprune.h"
+#include "aabbtree.h"
+#include <memory>
+#include <string>
+
+const float AABB_TREE_MARGIN = 4.0f;
+
+// Names accepted by --broadphase=. Returns nullptr for anything else.
+inline std::unique_ptr<Broadphase> makeBroadphase(const std::string &name, float cellSize){
+    if(name == "hash") return std::make_unique<SpatialHash>(cellSize);
+    if(name == "sap") return std::make_unique<SweepAndPrune>();
+    if(name == "tree") return std::make_unique<AABBTree>(AABB_TREE_MARGIN);
+    return nullptr;
+}
+
+// Passes every call through and logs it, one per line, so broadphase_bench
+// can replay exactly what a play session asked of the broadphase:
+//   c | i handle x y w h | r handle | m handle x y w h | q x y w h
+class RecordingBroadphase : public Broadphase{
+    std::unique_ptr<Broadphase> inner;
+    SDL_IOStream *file;
+
+    void log(char op, const SDL_FRect &rect) const {
+        SDL_IOprintf(file, "%c %.9g %.9g %.9g %.9g\n", op, rect.x, rect.y, rect.w, rect.h);
+    }
+    void log(char op, uint32_t handle, const SDL_FRect &rect) const {
+        SDL_IOprintf(file, "%c %u %.9g %.9g %.9g %.9g\n", op, handle, rect.x, rect.y, rect.w, rect.h);
+    }
+public:
+    RecordingBroadphase(std::unique_ptr<Broadphase> inner, SDL_IOStream *file) : inner(std::move(inner)), file(file) {}
+    ~RecordingBroadphase() override {
+        SDL_CloseIO(file);
+    }
+
+    void clear() override {
+        SDL_IOprintf(file, "c\n");
+        inner->clear();
+    }
+    void insert(uint32_t handle, const SDL_FRect &rect) override {
+        log('i', handle, rect);
+        inner->insert(handle, rect);
+    }
+    void remove(uint32_t handle) override {
+        SDL_IOprintf(file, "r %u\n", handle);
+        inner->remove(handle);
+    }
+    void move(uint32_t handle, const SDL_FRect &rect) override {
+        log('m', handle, rect);
+        inner->move(handle, rect);
+    }
+    void query(const SDL_FRect &rect, std::vector<uint32_t> &out) const override {
+        log('q', rect);
+        inner->query(rect, out);
+    }
+};
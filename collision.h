@@ -0,0 +1,180 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <bit>
+#include <limits>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Slab times along one axis for box [aMin, aMin + aLen] moving by d against
+// [bMin, bMin + bLen]. A box that isn't moving on this axis is either always
+// overlapping it or never.
+inline bool sweepAxis(float aMin, float aLen, float d, float bMin, float bLen, float &entry, float &exit){
+    const float inf = std::numeric_limits<float>::infinity();
+    if(d == 0.0f){
+        if(aMin + aLen < bMin || aMin > bMin + bLen) return false;
+        entry = -inf;
+        exit = inf;
+        return true;
+    }
+    const float near = (d > 0.0f) ? bMin - (aMin + aLen) : (bMin + bLen) - aMin;
+    const float far = (d > 0.0f) ? (bMin + bLen) - aMin : bMin - (aMin + aLen);
+    entry = near / d;
+    exit = far / d;
+    return true;
+}
+
+// Time of impact of box a moving by delta against the static box b, as a
+// fraction of delta. Only hits that start strictly after t = 0 count; boxes
+// that already touch are the discrete test's business.
+inline bool sweepAABB(const SDL_FRect &a, glm::vec2 delta, const SDL_FRect &b, float &toi, glm::vec2 &normal){
+    if(b.w < 0.0f || b.h < 0.0f) return false;
+    float xEntry, xExit, yEntry, yExit;
+    if(!sweepAxis(a.x, a.w, delta.x, b.x, b.w, xEntry, xExit)) return false;
+    if(!sweepAxis(a.y, a.h, delta.y, b.y, b.h, yEntry, yExit)) return false;
+    const float entry = std::max(xEntry, yEntry);
+    const float exit = std::min(xExit, yExit);
+    if(entry > exit || entry <= 0.0f || entry > 1.0f) return false;
+    toi = entry;
+    if(xEntry > yEntry) normal = glm::vec2(delta.x > 0.0f ? -1.0f : 1.0f, 0.0f);
+    else normal = glm::vec2(0.0f, delta.y > 0.0f ? -1.0f : 1.0f);
+    return true;
+}
+
+// Distance along origin + dir * t, 0 <= t <= maxDist, at which the ray enters
+// b, and the face it enters through. A ray starting inside b hits at 0 with a
+// zero normal.
+inline bool rayAABB(glm::vec2 origin, glm::vec2 dir, float maxDist, const SDL_FRect &b, float &dist, glm::vec2 &normal){
+    if(b.w < 0.0f || b.h < 0.0f) return false;
+    const glm::vec2 delta = dir * maxDist;
+    float xEntry, xExit, yEntry, yExit;
+    if(!sweepAxis(origin.x, 0.0f, delta.x, b.x, b.w, xEntry, xExit)) return false;
+    if(!sweepAxis(origin.y, 0.0f, delta.y, b.y, b.h, yEntry, yExit)) return false;
+    const float entry = std::max(xEntry, yEntry);
+    const float exit = std::min(xExit, yExit);
+    if(entry > exit || exit < 0.0f || entry > 1.0f) return false;
+    if(entry <= 0.0f){
+        dist = 0.0f;
+        normal = glm::vec2(0);
+        return true;
+    }
+    dist = entry * maxDist;
+    if(xEntry > yEntry) normal = glm::vec2(delta.x > 0.0f ? -1.0f : 1.0f, 0.0f);
+    else normal = glm::vec2(0.0f, delta.y > 0.0f ? -1.0f : 1.0f);
+    return true;
+}
+
+// Overlap of two boxes that are known to touch, clamped so a contact on an
+// edge comes back as a zero-width or zero-height rect rather than a negative one.
+inline SDL_FRect contactRect(const SDL_FRect &a, const SDL_FRect &b){
+    SDL_FRect result;
+    result.x = std::max(a.x, b.x);
+    result.y = std::max(a.y, b.y);
+    result.w = std::max(std::min(a.x + a.w, b.x + b.w) - result.x, 0.0f);
+    result.h = std::max(std::min(a.y + a.h, b.y + b.h) - result.y, 0.0f);
+    return result;
+}
+
+// Candidate boxes for one narrowphase pass, stored as separate coordinate
+// arrays so the kernel below can load several boxes per instruction
+struct BoxBatch{
+    std::vector<float> x, y, w, h;
+
+    void clear(){
+        x.clear();
+        y.clear();
+        w.clear();
+        h.clear();
+    }
+    void push(const SDL_FRect &rect){
+        x.push_back(rect.x);
+        y.push_back(rect.y);
+        w.push_back(rect.w);
+        h.push_back(rect.h);
+    }
+    int size() const { return static_cast<int>(x.size()); }
+    SDL_FRect rect(int i) const { return SDL_FRect{x[i], y[i], w[i], h[i]}; }
+};
+
+struct BoxHit{
+    int idx;
+    SDL_FRect intersect;
+};
+
+// Tests a against boxes[first..] and appends every overlap, in index order,
+// to hits. Each lane repeats the exact float operations of
+// SDL_GetRectIntersectionFloat (same adds, same operand order in max/min,
+// same "not below zero" test), so hits and extents match it bit for bit.
+inline void intersectBatch(const SDL_FRect &a, const BoxBatch &boxes, int first, std::vector<BoxHit> &hits){
+    if(a.w < 0.0f || a.h < 0.0f) return;
+    const int count = boxes.size();
+    int i = first;
+    const auto collect = [&](int base, int mask, const float *ix, const float *iy, const float *iw, const float *ih){
+        while(mask){
+            const int lane = std::countr_zero(static_cast<unsigned>(mask));
+            hits.push_back(BoxHit{base + lane, SDL_FRect{ix[lane], iy[lane], iw[lane], ih[lane]}});
+            mask &= mask - 1;
+        }
+    };
+#if defined(__AVX__)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 ax = _mm256_set1_ps(a.x), axMax = _mm256_set1_ps(a.x + a.w);
+        const __m256 ay = _mm256_set1_ps(a.y), ayMax = _mm256_set1_ps(a.y + a.h);
+        alignas(32) float ix[8], iy[8], iw[8], ih[8];
+        for(; i + 8 <= count; i += 8){
+            const __m256 bx = _mm256_loadu_ps(&boxes.x[i]), bw = _mm256_loadu_ps(&boxes.w[i]);
+            const __m256 by = _mm256_loadu_ps(&boxes.y[i]), bh = _mm256_loadu_ps(&boxes.h[i]);
+            const __m256 x = _mm256_max_ps(bx, ax);
+            const __m256 w = _mm256_sub_ps(_mm256_min_ps(_mm256_add_ps(bx, bw), axMax), x);
+            const __m256 y = _mm256_max_ps(by, ay);
+            const __m256 h = _mm256_sub_ps(_mm256_min_ps(_mm256_add_ps(by, bh), ayMax), y);
+            const __m256 keep = _mm256_and_ps(
+                _mm256_and_ps(_mm256_cmp_ps(bw, zero, _CMP_NLT_UQ), _mm256_cmp_ps(bh, zero, _CMP_NLT_UQ)),
+                _mm256_and_ps(_mm256_cmp_ps(w, zero, _CMP_NLT_UQ), _mm256_cmp_ps(h, zero, _CMP_NLT_UQ)));
+            const int mask = _mm256_movemask_ps(keep);
+            if(!mask) continue;
+            _mm256_store_ps(ix, x);
+            _mm256_store_ps(iy, y);
+            _mm256_store_ps(iw, w);
+            _mm256_store_ps(ih, h);
+            collect(i, mask, ix, iy, iw, ih);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 ax = _mm_set1_ps(a.x), axMax = _mm_set1_ps(a.x + a.w);
+        const __m128 ay = _mm_set1_ps(a.y), ayMax = _mm_set1_ps(a.y + a.h);
+        alignas(16) float ix[4], iy[4], iw[4], ih[4];
+        for(; i + 4 <= count; i += 4){
+            const __m128 bx = _mm_loadu_ps(&boxes.x[i]), bw = _mm_loadu_ps(&boxes.w[i]);
+            const __m128 by = _mm_loadu_ps(&boxes.y[i]), bh = _mm_loadu_ps(&boxes.h[i]);
+            const __m128 x = _mm_max_ps(bx, ax);
+            const __m128 w = _mm_sub_ps(_mm_min_ps(_mm_add_ps(bx, bw), axMax), x);
+            const __m128 y = _mm_max_ps(by, ay);
+            const __m128 h = _mm_sub_ps(_mm_min_ps(_mm_add_ps(by, bh), ayMax), y);
+            const __m128 keep = _mm_and_ps(
+                _mm_and_ps(_mm_cmpnlt_ps(bw, zero), _mm_cmpnlt_ps(bh, zero)),
+                _mm_and_ps(_mm_cmpnlt_ps(w, zero), _mm_cmpnlt_ps(h, zero)));
+            const int mask = _mm_movemask_ps(keep);
+            if(!mask) continue;
+            _mm_store_ps(ix, x);
+            _mm_store_ps(iy, y);
+            _mm_store_ps(iw, w);
+            _mm_store_ps(ih, h);
+            collect(i, mask, ix, iy, iw, ih);
+        }
+    }
+#endif
+    for(; i < count; i++){
+        const SDL_FRect b = boxes.rect(i);
+        SDL_FRect intersect;
+        if(SDL_GetRectIntersectionFloat(&a, &b, &intersect)) hits.push_back(BoxHit{i, intersect});
+    }
+}
@@ -0,0 +1,65 @@
+// Checks that contact damage keeps to one hit per hitRate however the
+// contact comes and goes. Collision response leaves bodies exactly touching,
+// or a rounding error apart, so a player and an enemy can enter and exit
+// contact on alternate ticks; that must not hurt more than staying in touch.
+// The contacts go through a real ContactCache and the damage through the
+// same ContactDamage the game's contact handlers call.
+#include <SDL3/SDL.h>
+#include "gameobject.h"
+#include "contacts.h"
+
+const float SIM_STEP = 1.0f / 120.0f;
+const float DURATION = 3.0f;
+const uint32_t PLAYER_HANDLE = 1, ENEMY_HANDLE = 2;
+
+struct Outcome{
+    float hpLost;
+    int enters, exits;
+};
+
+// Runs DURATION seconds of ticks with the pair touching on the ticks
+// touching(tick) returns true for
+template<typename F>
+Outcome run(F touching){
+    GameObject player, enemy;
+    player.type = ObjectType::player;
+    player.data.player = PlayerData();
+    player.handle = PLAYER_HANDLE;
+    enemy.type = ObjectType::enemy;
+    enemy.data.enemy = EnemyData();
+    enemy.handle = ENEMY_HANDLE;
+    const float startHP = player.data.player.HP;
+
+    ContactCache contacts;
+    Outcome out{0.0f, 0, 0};
+    const SDL_FRect touch{0.0f, 0.0f, 0.0f, 32.0f};
+    for(int tick = 0; tick * SIM_STEP < DURATION; tick++){
+        contacts.beginTick();
+        enemy.data.enemy.coolDown(SIM_STEP); // as in the enemy's update()
+        if(touching(tick)){
+            // Both ways round, as OnContactEnter and OnContactStay are called
+            if(contacts.record(PLAYER_HANDLE, ENEMY_HANDLE, touch) == ContactEvent::enter) out.enters++;
+            ContactDamage(player, enemy);
+            ContactDamage(enemy, player);
+        }
+        contacts.endTick([](uint32_t, uint32_t){ return false; }, [&out](uint32_t, uint32_t){ out.exits++; });
+    }
+    out.hpLost = startHP - player.data.player.HP;
+    return out;
+}
+
+int main(int argc, char* argv[]){
+    const float most = (static_cast<int>(DURATION / EnemyData().hitRate.getLength()) + 1) * 10.0f;
+    const Outcome steady = run([](int){ return true; });
+    const Outcome flicker = run([](int tick){ return tick % 2 == 0; });
+    const Outcome bursts = run([](int tick){ return tick % 3 != 2; });
+    SDL_Log("HP lost over %.1f s: steady %.0f, flicker %.0f (%d enters), bursts %.0f (%d enters), at most %.0f",
+        DURATION, steady.hpLost, flicker.hpLost, flicker.enters, bursts.hpLost, bursts.enters, most);
+    // The cache has to see the flickering pairs come and go, or this proves nothing
+    bool ok = steady.enters == 1 && flicker.exits >= flicker.enters - 1 && flicker.enters > 1 && bursts.enters > 1;
+    if(!ok) SDL_Log("contact cache didn't report the expected enters and exits");
+    const bool capped = steady.hpLost > 0.0f && steady.hpLost <= most &&
+        flicker.hpLost <= steady.hpLost && bursts.hpLost <= steady.hpLost;
+    if(!capped) SDL_Log("contact damage ignores its cooldown");
+    return ok && capped ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+enum class ContactEvent{
+    enter, stay
+};
+
+// Contacts that survive from one tick to the next, keyed by the handles of
+// the two bodies. Anything not seen again during a tick is dropped by
+// endTick() and reported as an exit.
+class ContactCache{
+    struct Contact{
+        SDL_FRect intersect;
+        uint32_t tick;
+    };
+    // Where a body ended its last contact pass and the tile contacts it had
+    // there, against tile map version tiles. settled means none of those
+    // contacts pushed it.
+    struct BodyRecord{
+        SDL_FRect rect;
+        uint32_t tileVersion;
+        std::vector<uint32_t> tiles;
+        std::vector<SDL_FRect> tileRects;
+        bool settled;
+    };
+
+    std::unordered_map<uint64_t, Contact> contacts;
+    std::unordered_map<uint32_t, BodyRecord> bodies;
+    uint32_t tick;
+
+    static uint64_t key(uint32_t a, uint32_t b){
+        return (static_cast<uint64_t>(a) << 32) | b;
+    }
+public:
+    ContactCache() : tick(0) {}
+
+    void clear(){
+        contacts.clear();
+        bodies.clear();
+    }
+
+    void beginTick(){
+        tick++;
+    }
+
+    ContactEvent record(uint32_t a, uint32_t b, const SDL_FRect &intersect){
+        auto [it, added] = contacts.try_emplace(key(a, b), Contact{intersect, tick});
+        if(!added){
+            it->second.intersect = intersect;
+            it->second.tick = tick;
+        }
+        return added ? ContactEvent::enter : ContactEvent::stay;
+    }
+
+    // Calls onExit(a, b) for every contact that wasn't recorded this tick and
+    // forgets it. Contacts for which keep(a, b) holds are left alone, for
+    // pairs that nobody was around to test this tick.
+    template<typename K, typename F>
+    void endTick(K keep, F onExit){
+        for(auto it = contacts.begin(); it != contacts.end(); ){
+            const uint32_t a = static_cast<uint32_t>(it->first >> 32), b = static_cast<uint32_t>(it->first);
+            if(it->second.tick != tick && !keep(a, b)){
+                onExit(a, b);
+                it = contacts.erase(it);
+            }
+            else{
+                ++it;
+            }
+        }
+    }
+
+    void settle(uint32_t body, const SDL_FRect &rect, uint32_t tileVersion, const std::vector<uint32_t> &tiles, const std::vector<SDL_FRect> &tileRects, bool settled){
+        BodyRecord &rec = bodies[body];
+        rec.rect = rect;
+        rec.tileVersion = tileVersion;
+        rec.tiles = tiles;
+        rec.tileRects = tileRects;
+        rec.settled = settled;
+    }
+
+    // Tiles never move, so a settled body that is exactly where it was last
+    // tick, on an unchanged tile map, touches exactly the same tile
+    // colliders, and nothing else can come into reach while its contacts
+    // keep not pushing it. Returns false when the tile contacts have to be
+    // detected from scratch.
+    template<typename F>
+    bool revalidateTiles(uint32_t body, const SDL_FRect &rect, uint32_t tileVersion, F fn) const {
+        auto it = bodies.find(body);
+        if(it == bodies.end() || !it->second.settled) return false;
+        const BodyRecord &rec = it->second;
+        if(rec.tileVersion != tileVersion) return false;
+        if(SDL_memcmp(&rec.rect, &rect, sizeof(SDL_FRect)) != 0) return false;
+        for(int i = 0; i < rec.tiles.size(); i++){
+            fn(rec.tiles[i], rec.tileRects[i]);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// Holds the loop to a target frame rate when vsync doesn't, by sleeping until
+// each frame's deadline, and measures how steady the frame times really are.
+class FramePacer{
+public:
+    static const int HISTORY = 120; // frames the stats are taken over
+private:
+    uint64_t frameNS; // 0 for no limit
+    uint64_t deadline, last;
+    std::array<uint64_t, HISTORY> times;
+    int count, next;
+    double mean, deviation, worst; // ms, refreshed once per HISTORY frames
+public:
+    FramePacer() : frameNS(0), deadline(0), last(0), count(0), next(0), mean(0.0), deviation(0.0), worst(0.0) {
+        times.fill(0);
+    }
+
+    void setTarget(int fps){
+        frameNS = fps > 0 ? SDL_NS_PER_SECOND / fps : 0;
+        deadline = 0;
+    }
+    int target() const { return frameNS ? static_cast<int>(SDL_NS_PER_SECOND / frameNS) : 0; }
+
+    // Call once per frame, right after presenting. Sleeps out the rest of the
+    // frame if there is a target, then returns the time since the last call
+    // in seconds.
+    float wait(){
+        uint64_t now = SDL_GetTicksNS();
+        if(frameNS){
+            if(deadline == 0 || now > deadline + frameNS){
+                // First frame, or so late that catching up would only bunch
+                // the next frames together
+                deadline = now + frameNS;
+            }
+            else{
+                if(now < deadline) SDL_DelayPrecise(deadline - now);
+                deadline += frameNS;
+            }
+            now = SDL_GetTicksNS();
+        }
+        const uint64_t elapsed = last ? now - last : 0;
+        last = now;
+        if(elapsed) record(elapsed);
+        return static_cast<float>(elapsed) / SDL_NS_PER_SECOND;
+    }
+
+    double meanMs() const { return mean; }
+    double deviationMs() const { return deviation; }
+    double worstMs() const { return worst; }
+private:
+    void record(uint64_t elapsed){
+        times[next] = elapsed;
+        next = (next + 1) % HISTORY;
+        if(++count < HISTORY) return;
+        count = 0;
+        double sum = 0.0, sumSq = 0.0, most = 0.0;
+        for(uint64_t t : times){
+            const double ms = t / 1e6;
+            sum += ms;
+            sumSq += ms * ms;
+            most = SDL_max(most, ms);
+        }
+        mean = sum / HISTORY;
+        deviation = std::sqrt(SDL_max(sumSq / HISTORY - mean * mean, 0.0));
+        worst = most;
+    }
+};
@@ -4,11 +4,32 @@
 #include <glm/glm.hpp>
 #include <SDL3/SDL.h>
 #include <vector>
+#include <array>
+#include <bit>
+#include <cstdint>
 
 enum class ObjectType{
     player, level, enemy, bullet
 };
 
+// Static bodies never move and are only ever collision targets. Kinematic
+// bodies are moved by their own update but don't get pushed around, and
+// dynamic bodies are integrated and initiate collisions.
+enum class BodyType{
+    staticBody, kinematicBody, dynamicBody
+};
+
+// One bit per kind of collider. A body only reacts to bodies whose layer bit
+// is set in its own mask.
+enum CollisionLayer : uint32_t{
+    COLLIDE_LEVEL = 1u << 0,
+    COLLIDE_PLAYER = 1u << 1,
+    COLLIDE_ENEMY = 1u << 2,
+    COLLIDE_CORPSE = 1u << 3,
+    COLLIDE_BULLET = 1u << 4,
+    COLLIDE_SPENT_BULLET = 1u << 5
+};
+
 enum class PlayerState{
     idle, running, jumping
 };
@@ -40,6 +61,17 @@ struct EnemyData{
     EnemyData() : HP(100.0f), HPmax(100.0f), dmgDuration(0.5f), state(enemyState::shambling), hitRate(0.7f) {
         hitRate.step(0.7f);
     }
+    // Contact damage is dealt at most once per hitRate. The cooldown runs
+    // whether or not the player is touching, so leaving and touching again
+    // doesn't hit any sooner.
+    void coolDown(float timeDelta){
+        if(!hitRate.isTmOut()) hitRate.step(timeDelta);
+    }
+    bool contactHit(){
+        if(!hitRate.isTmOut()) return false;
+        hitRate.reset();
+        return true;
+    }
 };
 struct LevelData{};
 
@@ -52,8 +84,9 @@ union ObjectData{
 
 struct GameObject{
     ObjectType type;
+    BodyType body;
     ObjectData data;
-    glm::vec2 pos, vel, acc;
+    glm::vec2 pos, prevPos, vel, acc;
     std::vector<Animation> animations;
     SDL_Texture *texture;
     SDL_FRect hitbox;
@@ -61,20 +94,68 @@ struct GameObject{
     int curAnimation, spriteFrame;
     float dir;
     float maxSpeedX;
-    bool dynamic, grounded, flashes;
+    uint32_t handle, collisionLayer, collisionMask;
+    bool hasGravity, grounded, flashes;
+    bool sleeping; // at rest and skipped by the simulation until something wakes it
     
     GameObject(): data{.level = LevelData()}, flashTimer(0.05)
     {
         type = ObjectType::level;
-        pos = vel = acc = glm::vec2(0);
+        body = BodyType::staticBody;
+        pos = prevPos = vel = acc = glm::vec2(0);
         curAnimation = -1;
         spriteFrame = 1;
         dir = 1;
         maxSpeedX = 0;
         texture = nullptr;
-        dynamic = false;
+        handle = 0;
+        collisionLayer = COLLIDE_LEVEL;
+        collisionMask = 0;
+        hasGravity = false;
         grounded = false;
+        sleeping = false;
         hitbox = {0};
         flashes = false;
     }
+};
+
+// What touching b does to a, on the tick a contact starts and on every tick
+// it lasts. Touching an enemy costs the player HP whenever the enemy's
+// hitRate has run out; separating leaves the cooldown running, so a pair that
+// flickers between touching and not can't hit any faster than one that
+// stays put.
+inline void ContactDamage(GameObject &a, GameObject &b){
+    if(a.type == ObjectType::player && b.type == ObjectType::enemy){
+        if(b.data.enemy.contactHit()) a.data.player.HP -= 10;
+    }
+}
+
+// Which layers each layer collides with. An object's layer follows from its
+// type and state, so classify() has to run again whenever either changes.
+class CollisionMatrix{
+    std::array<uint32_t, 32> masks;
+public:
+    CollisionMatrix() {
+        masks.fill(0);
+    }
+    void enable(uint32_t layer, uint32_t targets){ masks[std::countr_zero(layer)] |= targets; }
+    void disable(uint32_t layer, uint32_t targets){ masks[std::countr_zero(layer)] &= ~targets; }
+    uint32_t maskFor(uint32_t layer) const { return masks[std::countr_zero(layer)]; }
+
+    static uint32_t layerOf(const GameObject &obj){
+        switch(obj.type){
+            case ObjectType::player:
+                return COLLIDE_PLAYER;
+            case ObjectType::enemy:
+                return obj.data.enemy.state == enemyState::dead ? COLLIDE_CORPSE : COLLIDE_ENEMY;
+            case ObjectType::bullet:
+                return obj.data.bullet.state == BulletState::moving ? COLLIDE_BULLET : COLLIDE_SPENT_BULLET;
+            default:
+                return COLLIDE_LEVEL;
+        }
+    }
+    void classify(GameObject &obj) const {
+        obj.collisionLayer = layerOf(obj);
+        obj.collisionMask = maskFor(obj.collisionLayer);
+    }
 };
\ No newline at end of file
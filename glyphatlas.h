@@ -0,0 +1,129 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <vector>
+
+// SDL's debug font rendered once into a texture, printable ASCII in a grid
+// of 8x8 cells plus one solid white cell for untextured boxes. Text drawn
+// from it goes through SDL_RenderGeometry like everything else instead of
+// one SDL_RenderDebugText call per string.
+class GlyphAtlas{
+public:
+    static const int GLYPH_SIZE = SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE;
+    static const int COLUMNS = 16;
+    static const char FIRST_CHAR = ' ', LAST_CHAR = '~';
+private:
+    static const int SOLID_CELL = LAST_CHAR - FIRST_CHAR + 1;
+    static const int ROWS = (SOLID_CELL + COLUMNS) / COLUMNS;
+    SDL_Texture *texture;
+
+    SDL_FRect cell(int idx) const {
+        return SDL_FRect{
+            .x = static_cast<float>(idx % COLUMNS * GLYPH_SIZE),
+            .y = static_cast<float>(idx / COLUMNS * GLYPH_SIZE),
+            .w = static_cast<float>(GLYPH_SIZE),
+            .h = static_cast<float>(GLYPH_SIZE)
+        };
+    }
+public:
+    GlyphAtlas() : texture(nullptr) {}
+
+    // Draws the glyphs with a software renderer into a surface, so the
+    // result is a plain texture that survives render target resets
+    bool build(SDL_Renderer *renderer){
+        unload();
+        SDL_Surface *surface = SDL_CreateSurface(COLUMNS * GLYPH_SIZE, ROWS * GLYPH_SIZE, SDL_PIXELFORMAT_RGBA32);
+        if(!surface) return false;
+        SDL_FillSurfaceRect(surface, nullptr, 0);
+        SDL_Renderer *software = SDL_CreateSoftwareRenderer(surface);
+        if(!software){
+            SDL_DestroySurface(surface);
+            return false;
+        }
+        SDL_SetRenderDrawColor(software, 255, 255, 255, 255);
+        for(char c = FIRST_CHAR; c <= LAST_CHAR; c++){
+            const char text[2] = {c, '\0'};
+            const SDL_FRect at = cell(c - FIRST_CHAR);
+            SDL_RenderDebugText(software, at.x, at.y, text);
+        }
+        const SDL_FRect solid = cell(SOLID_CELL);
+        SDL_RenderFillRect(software, &solid);
+        SDL_FlushRenderer(software);
+        SDL_DestroyRenderer(software);
+        texture = SDL_CreateTextureFromSurface(renderer, surface);
+        SDL_DestroySurface(surface);
+        if(!texture) return false;
+        SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        return true;
+    }
+
+    void unload(){
+        SDL_DestroyTexture(texture);
+        texture = nullptr;
+    }
+
+    SDL_Texture *page() const { return texture; }
+    // Characters outside the font come out as '?'
+    SDL_FRect glyph(char c) const {
+        if(c < FIRST_CHAR || c > LAST_CHAR) c = '?';
+        return cell(c - FIRST_CHAR);
+    }
+    // Texels inside the white cell, away from its edges
+    SDL_FRect solid() const {
+        SDL_FRect rect = cell(SOLID_CELL);
+        return SDL_FRect{rect.x + 2.0f, rect.y + 2.0f, rect.w - 4.0f, rect.h - 4.0f};
+    }
+};
+
+// Text and boxes built from a GlyphAtlas and kept until cleared, so a layer
+// that rarely changes, like the HUD, is one retained draw call per frame.
+class TextMesh{
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+
+    void quad(const GlyphAtlas &atlas, const SDL_FRect &dst, const SDL_FRect &src, SDL_FColor color){
+        SDL_Texture *tex = atlas.page();
+        if(!tex) return;
+        const float texW = static_cast<float>(tex->w), texH = static_cast<float>(tex->h);
+        const float u0 = src.x / texW, v0 = src.y / texH;
+        const float u1 = (src.x + src.w) / texW, v1 = (src.y + src.h) / texH;
+        const int base = static_cast<int>(vertices.size());
+        vertices.push_back(SDL_Vertex{{dst.x, dst.y}, color, {u0, v0}});
+        vertices.push_back(SDL_Vertex{{dst.x + dst.w, dst.y}, color, {u1, v0}});
+        vertices.push_back(SDL_Vertex{{dst.x + dst.w, dst.y + dst.h}, color, {u1, v1}});
+        vertices.push_back(SDL_Vertex{{dst.x, dst.y + dst.h}, color, {u0, v1}});
+        for(int corner : {0, 1, 2, 0, 2, 3}){
+            indices.push_back(base + corner);
+        }
+    }
+public:
+    void clear(){
+        vertices.clear();
+        indices.clear();
+    }
+
+    // Laid out like SDL_RenderDebugText: one fixed-width cell per character
+    void text(const GlyphAtlas &atlas, float x, float y, const char *str, SDL_FColor color){
+        const float size = static_cast<float>(GlyphAtlas::GLYPH_SIZE);
+        for(; *str; str++, x += size){
+            if(*str == ' ') continue;
+            quad(atlas, SDL_FRect{x, y, size, size}, atlas.glyph(*str), color);
+        }
+    }
+    void fill(const GlyphAtlas &atlas, const SDL_FRect &rect, SDL_FColor color){
+        quad(atlas, rect, atlas.solid(), color);
+    }
+    // One pixel wide along the inside of rect, like SDL_RenderRect
+    void outline(const GlyphAtlas &atlas, const SDL_FRect &rect, SDL_FColor color){
+        fill(atlas, SDL_FRect{rect.x, rect.y, rect.w, 1.0f}, color);
+        fill(atlas, SDL_FRect{rect.x, rect.y + rect.h - 1.0f, rect.w, 1.0f}, color);
+        fill(atlas, SDL_FRect{rect.x, rect.y + 1.0f, 1.0f, rect.h - 2.0f}, color);
+        fill(atlas, SDL_FRect{rect.x + rect.w - 1.0f, rect.y + 1.0f, 1.0f, rect.h - 2.0f}, color);
+    }
+
+    void draw(SDL_Renderer *renderer, const GlyphAtlas &atlas) const {
+        if(indices.empty()) return;
+        SDL_RenderGeometry(renderer, atlas.page(), vertices.data(), static_cast<int>(vertices.size()), indices.data(), static_cast<int>(indices.size()));
+    }
+};
@@ -5,7 +5,23 @@
 #include <string>
 #include <array>
 #include <format>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "gameobject.h"
+#include "broadphases.h"
+#include "tilemap.h"
+#include "collision.h"
+#include "contacts.h"
+#include "spritemask.h"
+#include "atlas.h"
+#include "spritebatch.h"
+#include "tilechunks.h"
+#include "parallax.h"
+#include "glyphatlas.h"
+#include "triplebuffer.h"
+#include "framepacer.h"
 
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
@@ -14,11 +30,16 @@
 struct SDLState{
     SDL_Window *window;
     SDL_Renderer *renderer;
+    SDL_Surface *surface; // what the renderer draws into when headless
     int w, h, logW, logH;
     const bool *keys;
     ma_engine engine;
+    bool headless; // no window, vsync or audio device
+    int targetFPS; // from --fps, or -1 to follow the display
+    int vsync; // what the renderer accepted, 0 when the pacer keeps time
+    FramePacer pacer;
     
-    SDLState() : keys(SDL_GetKeyboardState(nullptr)) {}
+    SDLState() : window(nullptr), renderer(nullptr), surface(nullptr), keys(SDL_GetKeyboardState(nullptr)), headless(false), targetFPS(-1), vsync(0) {}
 };
 
 enum class currentInterface{
@@ -41,17 +62,36 @@ struct Resource{
     const int ENEMY_DYING_ANIMATION = 2;
     std::vector<Animation> animationsPlayer, animationsBullet, animationsEnemy;
     std::vector<SDL_Texture*> textures;
+    std::unordered_map<SDL_Texture*, SpriteMask> masks;
+    TextureAtlas atlas;
+    // The game's backgrounds, composed to the logical resolution. The menu
+    // still draws the plain textures.
+    ParallaxStrip bckgrnd1Strip, bckgrnd2Strip, bckgrnd3Strip, bckgrnd4Strip;
+    GlyphAtlas glyphs;
     SDL_Texture* idleTex, *runTex, *groundTex, *panelTex, *enemyTex, *grassTex, *brickTex, *slideTex, *bckgrnd1Tex, *bckgrnd2Tex, 
                 *bckgrnd3Tex, *bckgrnd4Tex, *bulletTex, *bulletHitTex, *shootTex, *runShootTex, *slideShootTex, *enemyHitTex,
                 *enemyDieTex;
 
-    SDL_Texture* getTex(const std::string &path, SDL_Renderer *renderer){
-        SDL_Texture *tex = IMG_LoadTexture(renderer, path.c_str());
+    // Goes through a surface so the collision masks and the atlas can be
+    // made from the pixels before they end up on the GPU. With keep set the
+    // surface is handed over instead of destroyed.
+    SDL_Texture* getTex(const std::string &path, SDL_Renderer *renderer, SDL_Surface **keep = nullptr){
+        SDL_Surface *surface = IMG_Load(path.c_str());
+        SDL_Texture *tex = SDL_CreateTextureFromSurface(renderer, surface);
         SDL_SetTextureScaleMode(tex, SDL_SCALEMODE_NEAREST);
         textures.push_back(tex);
+        if(tex) masks[tex].build(surface);
+        atlas.add(tex, surface);
+        if(keep) *keep = surface;
+        else SDL_DestroySurface(surface);
         return tex;
     }
 
+    const SpriteMask *getMask(SDL_Texture *tex) const {
+        auto it = masks.find(tex);
+        return (it == masks.end() || it->second.empty()) ? nullptr : &it->second;
+    }
+
     void load(SDLState &state){
         animationsPlayer.resize(5);
         animationsPlayer[PLAYER_IDLE_ANIMATION] = Animation(8, 1.6f);
@@ -74,10 +114,18 @@ struct Resource{
         //enemyTex = getTex("resources/enemy.png", state.renderer);
         grassTex = getTex("resources/tiles/grass.png", state.renderer);
         brickTex = getTex("resources/tiles/brick.png", state.renderer);
-        bckgrnd1Tex = getTex("resources/bckgrnd/bg_layer1.png", state.renderer);
-        bckgrnd2Tex = getTex("resources/bckgrnd/bg_layer2.png", state.renderer);
-        bckgrnd3Tex = getTex("resources/bckgrnd/bg_layer3.png", state.renderer);
-        bckgrnd4Tex = getTex("resources/bckgrnd/bg_layer4.png", state.renderer);
+        SDL_Surface *bckgrnd[4];
+        bckgrnd1Tex = getTex("resources/bckgrnd/bg_layer1.png", state.renderer, &bckgrnd[0]);
+        bckgrnd2Tex = getTex("resources/bckgrnd/bg_layer2.png", state.renderer, &bckgrnd[1]);
+        bckgrnd3Tex = getTex("resources/bckgrnd/bg_layer3.png", state.renderer, &bckgrnd[2]);
+        bckgrnd4Tex = getTex("resources/bckgrnd/bg_layer4.png", state.renderer, &bckgrnd[3]);
+        bckgrnd1Strip.buildFill(state.renderer, bckgrnd[0], state.logW, state.logH);
+        bckgrnd2Strip.buildWrap(state.renderer, bckgrnd[1], state.logW, 30.0f);
+        bckgrnd3Strip.buildWrap(state.renderer, bckgrnd[2], state.logW, 30.0f);
+        bckgrnd4Strip.buildWrap(state.renderer, bckgrnd[3], state.logW, 30.0f);
+        for(SDL_Surface *surface : bckgrnd){
+            SDL_DestroySurface(surface);
+        }
         bulletTex = getTex("resources/bullet.png", state.renderer);
         bulletHitTex = getTex("resources/bullet_hit.png", state.renderer);
         shootTex = getTex("resources/shoot.png", state.renderer);
@@ -86,28 +134,110 @@ struct Resource{
         enemyTex = getTex("resources/enemy.png", state.renderer);
         enemyHitTex = getTex("resources/enemy_hit.png", state.renderer);
         enemyDieTex = getTex("resources/enemy_die.png", state.renderer);
+        atlas.build(state.renderer);
+        glyphs.build(state.renderer);
     }
 
     void unload(){
         for(SDL_Texture* tex : textures){
             SDL_DestroyTexture(tex);
         }
+        atlas.unload();
+        bckgrnd1Strip.unload();
+        bckgrnd2Strip.unload();
+        bckgrnd3Strip.unload();
+        bckgrnd4Strip.unload();
+        glyphs.unload();
     }
 };
 
 const int LAYER_LEVEL_IDX = 0;
 const int LAYER_CHARACTER_IDX = 1;
+const float GRID_CELL_SIZE = 64.0f;
 
-struct GameState{
-    std::array<std::vector<GameObject>, 2>layers;
-    std::vector<GameObject> BackgroundTile;
-    std::vector<GameObject> ForegroundTile;
-    std::vector<GameObject> Bullets;
+// Body handles: layer index in the top byte, object index below it. Tile
+// colliders and bullets get their own pseudo-layers.
+const int TILE_HANDLES = 0x10;
+const int BULLET_HANDLES = 0x11;
+inline uint32_t makeHandle(int layer, int idx){ return (static_cast<uint32_t>(layer) << 24) | static_cast<uint32_t>(idx); }
+inline int handleLayer(uint32_t handle){ return static_cast<int>(handle >> 24); }
+inline int handleIdx(uint32_t handle){ return static_cast<int>(handle & 0xFFFFFF); }
+
+// What a ray ran into first. target is nullptr when that was a level tile.
+struct RayHit{
+    GameObject *target;
+    float distance;
+    glm::vec2 point, normal;
+};
+
+// Everything the HUD shows. It is only rebuilt when one of these changes.
+struct HudValues{
+    float hp, hpMax;
+    bool debug;
+    int playerState, bullets, grounded, idleBullets, drawn, culled;
+    float bulletX, viewX;
+    int vsync, fpsCap;
+    float frameMean, frameDeviation, frameWorst;
+    bool operator==(const HudValues &other) const = default;
+};
+
+// One sprite as the simulation left it
+struct SpriteSnapshot{
+    SDL_Texture *texture;
+    glm::vec2 prevPos, pos;
+    SDL_FRect hitbox;
+    float width, height, dir;
+    int frame, layer;
+    bool flashes;
+};
+
+// Everything drawing needs from the simulation, copied out after a tick.
+// The render side only ever reads these, never GameState.
+struct RenderSnapshot{
+    std::vector<SpriteSnapshot> sprites; // near the camera, in draw order
+    int culled; // bodies and bullets left out of sprites
+    uint64_t dueNS; // wall clock time the last tick stands for
+    glm::vec2 playerPrevPos, playerPos;
+    float playerVelX, hp, hpMax;
+    int playerState, bullets, grounded, idleBullets;
+    float bulletX, viewX;
+    // The tiles as of tilesVersion, never written again once shared, and
+    // the columns that changed since the previous version
+    std::shared_ptr<const TileMap> tiles;
+    uint64_t tilesVersion;
+    int tilesC0, tilesC1;
+};
+
+struct InputEvent{
+    SDL_Scancode key;
+    bool pressed;
+};
+
+// Between the main thread and the simulation: key presses go one way,
+// snapshots of the world the other
+struct SimLink{
+    std::mutex inputLock;
+    std::vector<InputEvent> input; // since the simulation last took it
+    TripleBuffer<RenderSnapshot> snapshots;
+    std::atomic<bool> running, paused;
+    SimLink() : running(false), paused(false) {}
+};
+
+// What belongs to drawing. It stays on the main thread while the
+// simulation runs on its own.
+struct RenderState{
     SDL_FRect MapViewport;
-    int playerIdx;
+    SpriteBatch batch;
+    TileChunks behindTiles, frontTiles; // background + level, and foreground
+    TextMesh hud;
+    HudValues hudShown;
+    bool hudBuilt;
+    uint64_t tilesVersion; // of the tiles the chunks were drawn from
+    uint64_t hudDebugDue; // when the debug readouts may next change
+    int drawnCount, culledCount;
     float bg2scroll, bg3scroll, bg4scroll;
     bool debugMode;
-    GameState(const SDLState &state) : playerIdx(-1) {
+    RenderState(const SDLState &state) {
         MapViewport = SDL_FRect{
             .x = 0,
             .y = 0,
@@ -116,10 +246,67 @@ struct GameState{
         };
         bg2scroll = bg3scroll = bg4scroll = 0.0f;
         debugMode = false;
+        drawnCount = culledCount = 0;
+        hudShown = HudValues{};
+        hudBuilt = false;
+        tilesVersion = 0;
+        hudDebugDue = 0;
+    }
+};
+
+struct GameState{
+    // Grid tiles live in the TileMap; the level layer is for level objects
+    // that move or need their own state.
+    std::array<std::vector<GameObject>, 2>layers;
+    TileMap tiles;
+    std::shared_ptr<const TileMap> tileView; // copy handed to the renderer
+    uint64_t tileVersion;
+    int tileChangedC0, tileChangedC1; // columns tileView changed from the version before
+    GameObject tileBody; // stand-in passed to CollisionResponse for grid tiles
+    std::unique_ptr<Broadphase> broadphase;
+    std::vector<uint32_t> nearby;
+    BoxBatch candidates;
+    std::vector<uint32_t> candidateHandles;
+    std::vector<BoxHit> hits;
+    ContactCache contacts;
+    std::vector<uint32_t> tileContacts;
+    std::vector<SDL_FRect> tileContactRects;
+    std::vector<GameObject> Bullets;
+    CollisionMatrix collisionRules;
+    SDL_FRect MapViewport, activeRegion;
+    std::vector<uint32_t> active; // broadphase bodies inside activeRegion this tick
+    std::vector<uint32_t> woken; // sleeping bodies touched during the contact pass
+    std::vector<uint32_t> inAggroRange; // sleeping enemies WakeNearPlayer is checking
+    std::vector<uint32_t> visible; // broadphase bodies near the camera at the last snapshot
+    std::array<bool, SDL_SCANCODE_COUNT> keys; // held keys, as of the last tick
+    std::vector<InputEvent> pendingInput;
+    int playerIdx;
+    GameState(const SDLState &state) : tileVersion(0), tileChangedC0(0), tileChangedC1(-1), broadphase(std::make_unique<SpatialHash>(GRID_CELL_SIZE)), playerIdx(-1) {
+        MapViewport = SDL_FRect{
+            .x = 0,
+            .y = 0,
+            .w = static_cast<float>(state.logW),
+            .h = static_cast<float>(state.logH)
+        };
+        keys.fill(false);
+        collisionRules.enable(COLLIDE_PLAYER, COLLIDE_LEVEL | COLLIDE_ENEMY);
+        collisionRules.enable(COLLIDE_ENEMY, COLLIDE_LEVEL | COLLIDE_PLAYER | COLLIDE_ENEMY);
+        collisionRules.enable(COLLIDE_CORPSE, COLLIDE_LEVEL);
+        collisionRules.enable(COLLIDE_BULLET, COLLIDE_LEVEL | COLLIDE_PLAYER | COLLIDE_ENEMY);
     }
     GameObject &getPlayer(){
         return layers[LAYER_CHARACTER_IDX][playerIdx];
     }
+    GameObject &getBody(uint32_t handle){
+        switch(handleLayer(handle)){
+            case TILE_HANDLES:
+                return tileBody;
+            case BULLET_HANDLES:
+                return Bullets[handleIdx(handle)];
+            default:
+                return layers[handleLayer(handle)][handleIdx(handle)];
+        }
+    }
 };
 
 const int MAX_ROWS = 5;
@@ -127,16 +314,59 @@ const int MAX_COLS = 50;
 const int TILE_SIZE = 32;
 const int HP_BAR_WIDTH = 150;
 const int HP_BAR_HEIGHT = 15;
+const float SIM_STEP = 1.0f / 120.0f;
+const uint64_t SIM_STEP_NS = SDL_NS_PER_SECOND / 120;
+// Draw order of the sprite batch, back to front
+enum DrawLayer{
+    DRAW_BACKGROUND_TILES, DRAW_LEVEL_TILES, DRAW_CHARACTERS, DRAW_BULLETS, DRAW_FOREGROUND_TILES
+};
+const int MAX_SIM_STEPS = 8;
+const int HEADLESS_FRAMES = 600;
+const int DEFAULT_FPS = 60; // when neither vsync nor the display says otherwise
+const int IDLE_WAIT_MS = 100; // longest an idle loop sleeps before checking in again
+const int HUD_DEBUG_REFRESH_MS = 250; // debug readouts change every frame, so they only update this often
+const float HEADLESS_FRAME_TIME = 1.0f / 60.0f; // fixed, so every run simulates the same
+const float ENEMY_AGGRO_RANGE = 100.0f;
+const SDL_FColor HIT_FLASH_TINT{2.5f, 1.0f, 1.0f, 1.0f};
+const int ACTIVE_REGION_SCREENS = 1; // simulated margin around the viewport, each side
+// Broadphase rects are hitboxes at the last tick, so the drawn sprite can
+// reach up to a sprite's size outside of them
+const float CULL_MARGIN = TILE_SIZE;
 
 void cleanup(SDLState &state);
 bool init(SDLState &state);
-void DrawObj(const SDLState &state, GameState &gs, GameObject &obj, float width, float height, float timeDelta);
+void DrawObj(const SDLState &state, RenderState &rs, const Resource &res, const SpriteSnapshot &sprite, float alpha);
+void DrawHitboxes(const SDLState &state, const RenderState &rs, const RenderSnapshot &snap, float alpha);
+void simulate(const SDLState &state, GameState &gs, Resource &res, float timeDelta);
+void Tick(const SDLState &state, GameState &gs, Resource &res, SimLink &link);
+void TakeSnapshot(GameState &gs, RenderSnapshot &snap);
+void RunSimulation(const SDLState &state, GameState &gs, Resource &res, SimLink &link);
+SDL_FRect hitboxRect(const GameObject &obj);
+int CurrentFrame(const GameObject &obj);
+bool NeedsPixelTest(const GameObject &a, const GameObject &b);
+bool PixelsOverlap(const Resource &res, const GameObject &a, glm::vec2 posA, const GameObject &b, glm::vec2 posB);
+bool SweepPixels(const Resource &res, const GameObject &obj, glm::vec2 delta, const GameObject &other, const SDL_FRect &otherRect, float &toi);
+bool IsSimulated(const GameState &gs, const GameObject &obj);
+bool CanSleep(const GameObject &obj);
+void WakeNearPlayer(GameState &gs);
+bool Raycast(GameState &gs, glm::vec2 origin, glm::vec2 dir, float maxDist, uint32_t mask, const GameObject *ignore, RayHit &hit);
+bool HasLineOfSight(GameState &gs, const GameObject &from, const GameObject &to);
 void update(const SDLState &state, GameState &gs,GameObject &obj, Resource &res, float timeDelta, ma_engine engine);
-void CollisionDetection(const SDLState &state, GameState &gs, GameObject &a, GameObject &b, float timeDelta, Resource &res);
+bool SweepBullet(const SDLState &state, GameState &gs, GameObject &obj, Resource &res, glm::vec2 delta, float timeDelta);
+void FindContacts(const SDLState &state, GameState &gs, GameObject &obj, Resource &res, float timeDelta);
+void ResolveContacts(const SDLState &state, GameState &gs, GameObject &obj, Resource &res, float timeDelta);
+void ProbeGround(GameState &gs, GameObject &obj);
+void OnContactEnter(GameState &gs, GameObject &a, GameObject &b);
+void OnContactStay(GameState &gs, GameObject &a, GameObject &b, float timeDelta);
+void OnContactExit(GameState &gs, GameObject &a, GameObject &b);
 void CollisionResponse(const SDLState &state, Resource &res, GameState &gs, GameObject &a, GameObject &b, const SDL_FRect &recA, const SDL_FRect &recB, const SDL_FRect &intersect, float timeDelta, ma_engine engine);
 void createTiles(const SDLState &state, GameState &gs, Resource &res);
+void DrawTileLayer(const SDLState &state, RenderState &rs, const Resource &res, const TileMap &tiles, int layer, float x0, float x1);
+void DrawTileChunks(const SDLState &state, RenderState &rs, const Resource &res, const TileMap &tiles, TileChunks &chunks, int firstLayer, int lastLayer);
+void DrawColliders(const SDLState &state, RenderState &rs, const TileMap &tiles);
+void DrawHud(const SDLState &state, RenderState &rs, const Resource &res, const RenderSnapshot &snap);
 void HandleKey(const SDLState &state, GameState &gs, GameObject &obj, SDL_Scancode key, bool pressed);
-void DrawParallaxBackground(SDL_Renderer *renderer, SDL_Texture *tex, float xVel, float &scrollPos, float scrollFact, float timeDelta);
+void DrawParallaxBackground(const SDLState &state, const ParallaxStrip &strip, float xVel, float &scrollPos, float scrollFact, float timeDelta);
 
 int main(int argc, char* argv[]){
     float mx, my;
@@ -147,30 +377,117 @@ int main(int argc, char* argv[]){
     state.h = 900;
     state.logW = 640;
     state.logH = 320;
+    // --headless[=frames] skips the menu, renders that many game frames
+    // offscreen on the software renderer and reports how long they took.
+    // --fps=<n> turns vsync off and paces frames at n per second, 0 for
+    // as fast as possible.
+    int headlessFrames = 0;
+    for(int i = 1; i < argc; i++){
+        const std::string arg = argv[i];
+        if(arg == "--headless") headlessFrames = HEADLESS_FRAMES;
+        else if(arg.starts_with("--headless=")) headlessFrames = SDL_atoi(arg.c_str() + SDL_strlen("--headless="));
+        else if(arg.starts_with("--fps=")) state.targetFPS = SDL_max(SDL_atoi(arg.c_str() + SDL_strlen("--fps=")), 0);
+    }
+    state.headless = headlessFrames > 0;
+    if(state.headless) T = currentInterface::GAME;
     if(init(state) == false) return 1;
     ma_sound music;
     ma_sound_init_from_file(&state.engine, "resources/sound/Juhani Junkala.mp3", MA_SOUND_FLAG_LOOPING, NULL, NULL, &music);
     ma_sound_set_volume(&music, 0.3f);
     ma_sound_start(&music);
     GameState gs(state);
+    // --broadphase=hash|sap|tree picks the broadphase, --record-scene=<file>
+    // logs everything asked of it for broadphase_bench to replay
+    // --single-thread runs the simulation on the main thread between frames
+    std::string recordPath;
+    bool threaded = !state.headless;
+    for(int i = 1; i < argc; i++){
+        const std::string arg = argv[i];
+        if(arg == "--single-thread") threaded = false;
+        else if(arg.starts_with("--broadphase=")){
+            const std::string name = arg.substr(SDL_strlen("--broadphase="));
+            std::unique_ptr<Broadphase> broadphase = makeBroadphase(name, GRID_CELL_SIZE);
+            if(broadphase) gs.broadphase = std::move(broadphase);
+            else SDL_Log("Unknown broadphase '%s', using hash", name.c_str());
+        }
+        else if(arg.starts_with("--record-scene=")){
+            recordPath = arg.substr(SDL_strlen("--record-scene="));
+        }
+    }
+    if(!recordPath.empty()){
+        SDL_IOStream *file = SDL_IOFromFile(recordPath.c_str(), "w");
+        if(file) gs.broadphase = std::make_unique<RecordingBroadphase>(std::move(gs.broadphase), file);
+        else SDL_Log("Couldn't open %s: %s", recordPath.c_str(), SDL_GetError());
+    }
     res.load(state);
+    RenderState rs(state);
+    SimLink link;
+    std::thread simThread;
     restart:
     if(T == currentInterface::GAME){
         createTiles(state, gs, res);
+        rs.behindTiles.reset(MAX_COLS * TILE_SIZE, MAX_ROWS * TILE_SIZE);
+        rs.frontTiles.reset(MAX_COLS * TILE_SIZE, MAX_ROWS * TILE_SIZE);
+        // Something to draw before the first tick is in
+        gs.MapViewport.x = gs.getPlayer().pos.x + TILE_SIZE / 2 - state.logW / 2;
+        TakeSnapshot(gs, link.snapshots.writeBuffer());
+        link.snapshots.writeBuffer().dueNS = SDL_GetTicksNS();
+        link.snapshots.publish();
+        if(threaded){
+            link.running = true;
+            simThread = std::thread([&state, &gs, &res, &link]{ RunSimulation(state, gs, res, link); });
+        }
     }
     else{
         playButton = {static_cast<float>(state.logW/2-75), static_cast<float>(state.logH/2-15), 150, 30};
     }
 
-    uint64_t timeP = SDL_GetTicks();
+    float frameDelta = 0.0f;
+    float simAccumulator = 0.0f;
+    int framesDone = 0;
+    uint64_t simTicks = 0, renderTicks = 0, worstRenderTicks = 0;
+
+    // Nothing changes on the menu, and the game pauses while it is hidden or
+    // in the background, so those block on events instead of spinning and
+    // only draw when the window needs it
+    bool redraw = true, hidden = false, focused = true, wasPaused = false;
 
     bool running = true;
     while(running){
-        uint64_t timeC = SDL_GetTicks();
-        float timeDelta = (timeC - timeP) / 1000.0f;
+        const bool paused = T == currentInterface::GAME && (hidden || !focused);
+        link.paused = paused;
+        // No time passes for the game while paused, including the frame
+        // that ends it, or the simulation would catch up on the wait
+        float timeDelta = state.headless ? HEADLESS_FRAME_TIME : (paused || wasPaused ? 0.0f : frameDelta);
+        wasPaused = paused;
 
         SDL_Event event{0};
-        while(SDL_PollEvent(&event)){
+        const bool idle = T == currentInterface::MENU || paused;
+        bool pending = (idle && !redraw) ? SDL_WaitEventTimeout(&event, IDLE_WAIT_MS) : SDL_PollEvent(&event);
+        for(; pending; pending = SDL_PollEvent(&event)){
+            switch(event.type){
+                case SDL_EVENT_WINDOW_MINIMIZED:
+                case SDL_EVENT_WINDOW_OCCLUDED:
+                    hidden = true;
+                    break;
+                case SDL_EVENT_WINDOW_RESTORED:
+                case SDL_EVENT_WINDOW_EXPOSED:
+                    hidden = false;
+                    redraw = true;
+                    break;
+                case SDL_EVENT_WINDOW_RESIZED:
+                case SDL_EVENT_RENDER_TARGETS_RESET:
+                    redraw = true;
+                    break;
+                case SDL_EVENT_WINDOW_FOCUS_LOST:
+                    focused = false;
+                    break;
+                case SDL_EVENT_WINDOW_FOCUS_GAINED:
+                    focused = true;
+                    break;
+                default:
+                    break;
+            }
             if(T == currentInterface::MENU){
                 switch(event.type){
                     case SDL_EVENT_MOUSE_BUTTON_DOWN:
@@ -201,20 +518,34 @@ int main(int argc, char* argv[]){
                 case SDL_EVENT_WINDOW_RESIZED:
                     state.w = event.window.data1;
                     state.h = event.window.data2;
+                    break;
                 case SDL_EVENT_KEY_DOWN:
-                     HandleKey(state, gs, gs.getPlayer(), event.key.scancode, true);
+                     if(event.key.scancode == SDL_SCANCODE_ESCAPE) running = false;
+                     else{
+                         std::lock_guard<std::mutex> lock(link.inputLock);
+                         link.input.push_back(InputEvent{event.key.scancode, true});
+                     }
                      break;
                 case SDL_EVENT_KEY_UP:
-                     HandleKey(state, gs, gs.getPlayer(), event.key.scancode, false);
-                     if(event.key.scancode == SDL_SCANCODE_F10) gs.debugMode = !gs.debugMode;
+                     {
+                         std::lock_guard<std::mutex> lock(link.inputLock);
+                         link.input.push_back(InputEvent{event.key.scancode, false});
+                     }
+                     if(event.key.scancode == SDL_SCANCODE_F10) rs.debugMode = !rs.debugMode;
                      break;
+                case SDL_EVENT_RENDER_TARGETS_RESET:
+                    // The chunk textures survive but their contents don't
+                    rs.behindTiles.invalidateAll();
+                    rs.frontTiles.invalidateAll();
+                    break;
                 default:
                     break;
                 }
             }
         }
 
-        if(T == currentInterface::MENU){
+        if(T == currentInterface::MENU && redraw && !hidden){
+            redraw = false;
             SDL_RenderTexture(state.renderer, res.bckgrnd1Tex, nullptr, nullptr);
             SDL_RenderTexture(state.renderer, res.bckgrnd2Tex, nullptr, nullptr);
             SDL_RenderTexture(state.renderer, res.bckgrnd3Tex, nullptr, nullptr);
@@ -231,98 +562,111 @@ int main(int argc, char* argv[]){
             SDL_RenderPresent(state.renderer);
         }
 
-        if(T == currentInterface::GAME){
-            for(auto &layer : gs.layers){
-                for(GameObject &obj : layer){
-                    update(state, gs, obj, res, timeDelta, state.engine);
+        if(T == currentInterface::GAME && (!paused || (redraw && !hidden))){
+            redraw = false;
+            const uint64_t simStart = SDL_GetPerformanceCounter();
+            if(!threaded){
+                // Fixed-rate simulation: run as many ticks as the elapsed
+                // time covers, but give up on catching up after a long hitch
+                simAccumulator += timeDelta;
+                int steps = 0;
+                while(simAccumulator >= SIM_STEP && steps < MAX_SIM_STEPS){
+                    Tick(state, gs, res, link);
+                    simAccumulator -= SIM_STEP;
+                    steps++;
+                }
+                if(steps == MAX_SIM_STEPS) simAccumulator = 0.0f;
+                if(steps){
+                    TakeSnapshot(gs, link.snapshots.writeBuffer());
+                    link.snapshots.publish();
                 }
             }
-
-            for(GameObject &bullet : gs.Bullets){
-                update(state, gs, bullet, res, timeDelta, state.engine);
+            link.snapshots.acquire();
+            const RenderSnapshot &snap = link.snapshots.readBuffer();
+            // Draw between the snapshot's last two ticks, by how far past
+            // the last one the clock is
+            float alpha = simAccumulator / SIM_STEP;
+            if(threaded){
+                const double since = static_cast<double>(static_cast<int64_t>(SDL_GetTicksNS() - snap.dueNS));
+                alpha = glm::clamp(static_cast<float>(since / SIM_STEP_NS), 0.0f, 1.0f);
             }
+            const uint64_t renderStart = SDL_GetPerformanceCounter();
+            simTicks += renderStart - simStart;
 
-            gs.MapViewport.x = gs.getPlayer().pos.x + TILE_SIZE / 2 - state.logW / 2;
+            rs.MapViewport.x = glm::mix(snap.playerPrevPos, snap.playerPos, alpha).x + TILE_SIZE / 2 - state.logW / 2;
 
-            SDL_SetRenderDrawColor(state.renderer, 20, 10, 30, 255);
-            SDL_RenderClear(state.renderer);
-
-            SDL_RenderTexture(state.renderer, res.bckgrnd1Tex, nullptr, nullptr);
-            DrawParallaxBackground(state.renderer, res.bckgrnd4Tex, gs.getPlayer().vel.x, gs.bg4scroll, 0.075f, timeDelta);
-            DrawParallaxBackground(state.renderer, res.bckgrnd3Tex, gs.getPlayer().vel.x, gs.bg3scroll, 0.15f, timeDelta);
-            DrawParallaxBackground(state.renderer, res.bckgrnd2Tex, gs.getPlayer().vel.x, gs.bg2scroll, 0.3f, timeDelta);
-            if(gs.debugMode){
-                SDL_SetRenderDrawColor(state.renderer, 255, 0, 0, 255);
-                char stateText[64];
-                int idle_bullets = 0;
-                float Bx = 0.0, MVx = 0.0;
-                if(gs.Bullets.size()){
-                    if(gs.Bullets[0].data.bullet.state == BulletState::idle){
-                        idle_bullets++;
-                        Bx  = gs.Bullets[0].pos.x;
-                        MVx = gs.MapViewport.x;
-                    }
-                }
-                SDL_snprintf(stateText, sizeof(stateText), "S: %d B: %d Grnd: %d IB: %d Bx: %f MVx: %f", static_cast<int>(gs.getPlayer().data.player.state), gs.Bullets.size(), gs.getPlayer().grounded, idle_bullets, Bx, MVx);
-                
-
-                SDL_RenderDebugText(state.renderer, 5, 5, stateText);
+            // The back layer covers the whole screen unless it has holes
+            if(!res.bckgrnd1Strip.isOpaque()){
+                SDL_SetRenderDrawColor(state.renderer, 20, 10, 30, 255);
+                SDL_RenderClear(state.renderer);
             }
 
-            for(auto &obj : gs.BackgroundTile){
-                SDL_FRect to{
-                    .x = obj.pos.x - gs.MapViewport.x,
-                    .y = obj.pos.y,
-                    .w = static_cast<float>(obj.texture->w),
-                    .h = static_cast<float>(obj.texture->h)
-                };
-                SDL_RenderTexture(state.renderer, obj.texture, nullptr, &to);
-            }
+            res.bckgrnd1Strip.draw(state.renderer, 0.0f, state.logW);
+            DrawParallaxBackground(state, res.bckgrnd4Strip, snap.playerVelX, rs.bg4scroll, 0.075f, timeDelta);
+            DrawParallaxBackground(state, res.bckgrnd3Strip, snap.playerVelX, rs.bg3scroll, 0.15f, timeDelta);
+            DrawParallaxBackground(state, res.bckgrnd2Strip, snap.playerVelX, rs.bg2scroll, 0.3f, timeDelta);
 
-            for(auto &layer : gs.layers){
-                for(GameObject &obj : layer){
-                    DrawObj(state, gs, obj, TILE_SIZE, TILE_SIZE, timeDelta);
+            // The simulation owns gs.tiles; drawing goes by the snapshot's copy.
+            // Versions skipped between two snapshots leave no change range,
+            // so then every chunk is redrawn.
+            const TileMap &tiles = *snap.tiles;
+            if(snap.tilesVersion != rs.tilesVersion){
+                if(snap.tilesVersion == rs.tilesVersion + 1){
+                    const float size = tiles.getTileSize();
+                    rs.behindTiles.invalidate(snap.tilesC0 * size, (snap.tilesC1 + 1) * size);
+                    rs.frontTiles.invalidate(snap.tilesC0 * size, (snap.tilesC1 + 1) * size);
                 }
+                else{
+                    rs.behindTiles.invalidateAll();
+                    rs.frontTiles.invalidateAll();
+                }
+                rs.tilesVersion = snap.tilesVersion;
             }
+            DrawTileChunks(state, rs, res, tiles, rs.behindTiles, TileMap::BACKGROUND, TileMap::LEVEL);
+            if(rs.debugMode) DrawColliders(state, rs, tiles);
 
-            for(GameObject &gb : gs.Bullets){
-                if(gb.data.bullet.state != BulletState::idle) DrawObj(state, gs, gb, gb.hitbox.w, gb.hitbox.h, timeDelta);
-            }
-
-            for(auto &obj : gs.ForegroundTile){
-                SDL_FRect to{
-                    .x = obj.pos.x - gs.MapViewport.x,
-                    .y = obj.pos.y,
-                    .w = static_cast<float>(obj.texture->w),
-                    .h = static_cast<float>(obj.texture->h)
-                };
-                SDL_RenderTexture(state.renderer, obj.texture, nullptr, &to);
+            // The snapshot only has what was near the camera; the rest of the
+            // culling is against where the sprites end up this frame
+            rs.drawnCount = 0;
+            rs.culledCount = snap.culled;
+            for(const SpriteSnapshot &sprite : snap.sprites){
+                const glm::vec2 pos = glm::mix(sprite.prevPos, sprite.pos, alpha);
+                const SDL_FRect rect{pos.x, pos.y, sprite.width, sprite.height};
+                if(SDL_HasRectIntersectionFloat(&rect, &rs.MapViewport)){
+                    DrawObj(state, rs, res, sprite, alpha);
+                    rs.drawnCount++;
+                }
+                else{
+                    rs.culledCount++;
+                }
             }
 
-            float percHP = gs.getPlayer().data.player.HP / gs.getPlayer().data.player.HPmax;
-            percHP = glm::clamp(percHP, 0.0f, 1.0f);
-
-            char hpText[64];
-            SDL_SetRenderDrawColor(state.renderer, 255, 0, 0, 255);
-            SDL_snprintf(hpText, sizeof(hpText), "HP: %.0f / %.0f", gs.getPlayer().data.player.HP, gs.getPlayer().data.player.HPmax);
-            SDL_RenderDebugText(state.renderer, state.logW-200, 15, hpText);
-            SDL_FRect bg = {static_cast<float>(state.logW - 200), 25.0f, HP_BAR_WIDTH, HP_BAR_HEIGHT}, 
-            fg = {static_cast<float>(state.logW - 200), 25.0f, percHP*150, HP_BAR_HEIGHT},
-            brdr = {bg.x-1, bg.y-1, bg.w+2, bg.h+2};
-            SDL_SetRenderDrawColor(state.renderer, 50, 50, 50, 255);
-            SDL_RenderFillRect(state.renderer, &bg);
-            SDL_SetRenderDrawColor(state.renderer, 255, 255, 255, 255);
-            SDL_RenderRect(state.renderer, &brdr);
-            SDL_SetRenderDrawColor(state.renderer, 255 * (1-percHP), 255 * percHP, 0, 255);
-            SDL_RenderFillRect(state.renderer, &fg);
-            if(gs.getPlayer().data.player.state == PlayerState::jumping && gs.getPlayer().grounded){
-                gs.getPlayer().data.player.state = PlayerState::idle;
-            }
+            DrawTileChunks(state, rs, res, tiles, rs.frontTiles, TileMap::FOREGROUND, TileMap::FOREGROUND);
+            rs.batch.flush(state.renderer);
+            if(rs.debugMode) DrawHitboxes(state, rs, snap, alpha);
+            DrawHud(state, rs, res, snap);
             SDL_RenderPresent(state.renderer);
+            const uint64_t renderTime = SDL_GetPerformanceCounter() - renderStart;
+            renderTicks += renderTime;
+            worstRenderTicks = SDL_max(worstRenderTicks, renderTime);
+            if(state.headless && ++framesDone == headlessFrames) running = false;
         }
-        timeP = timeC;
+        frameDelta = state.pacer.wait();
 
     }
+    link.running = false;
+    if(simThread.joinable()) simThread.join();
+    if(state.headless && framesDone){
+        const double ms = 1000.0 / SDL_GetPerformanceFrequency();
+        SDL_Log("Headless: %d frames at %dx%d, %s renderer", framesDone, state.w, state.h, SDL_GetRendererName(state.renderer));
+        SDL_Log("  sim    %8.3f ms per frame", simTicks * ms / framesDone);
+        SDL_Log("  render %8.3f ms per frame, worst %.3f ms", renderTicks * ms / framesDone, worstRenderTicks * ms);
+    }
+    // A recording broadphase closes its file when destroyed, which has to
+    // happen while SDL is still up
+    gs.broadphase.reset();
+    rs.behindTiles.unload();
+    rs.frontTiles.unload();
     res.unload();
     cleanup(state);
     return 0;
@@ -331,90 +675,472 @@ int main(int argc, char* argv[]){
 void cleanup(SDLState &state){
     SDL_DestroyWindow(state.window);
     SDL_DestroyRenderer(state.renderer);
+    SDL_DestroySurface(state.surface);
     ma_engine_uninit(&state.engine);
     SDL_Quit();
 }
 
 bool init(SDLState &state){
     bool success = true;
+    // Headless runs work on machines without a display or a GPU
+    if(state.headless) SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen,dummy");
     if(!SDL_Init(SDL_INIT_VIDEO)){
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Error Initializing SDL3", nullptr);
         success = false;
     }
-    state.window = SDL_CreateWindow("Game", state.w, state.h, SDL_WINDOW_FULLSCREEN);
-    if(!state.window){
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Error Creating Window", nullptr);
-        cleanup(state);
-        success = false;
+    if(state.headless){
+        // No window; the software renderer draws into a surface the size
+        // the window would have been
+        state.surface = SDL_CreateSurface(state.w, state.h, SDL_PIXELFORMAT_XRGB8888);
+        if(!state.surface){
+            SDL_Log("Error Creating Surface: %s", SDL_GetError());
+            cleanup(state);
+            success = false;
+        }
+        state.renderer = SDL_CreateSoftwareRenderer(state.surface);
+    }
+    else{
+        state.window = SDL_CreateWindow("Game", state.w, state.h, SDL_WINDOW_FULLSCREEN);
+        if(!state.window){
+            SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Error Creating Window", nullptr);
+            cleanup(state);
+            success = false;
+        }
+        state.renderer = SDL_CreateRenderer(state.window, nullptr);
     }
-    state.renderer = SDL_CreateRenderer(state.window, nullptr);
     if(!state.renderer){
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Error Creating Renderer", nullptr);
         cleanup(state);
         success = false;
     }
-    if(ma_engine_init(NULL, &state.engine) != MA_SUCCESS){
+    // Without a device sounds still load and start, they are just never heard
+    ma_engine_config engineConfig = ma_engine_config_init();
+    if(state.headless){
+        engineConfig.noDevice = MA_TRUE;
+        engineConfig.channels = 2;
+        engineConfig.sampleRate = 48000;
+    }
+    if(ma_engine_init(&engineConfig, &state.engine) != MA_SUCCESS){
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Error initializing audio", nullptr);
         cleanup(state);
         success = false;
     }
-    SDL_SetRenderVSync(state.renderer, 1);
+    // Vsync when there is a display and no --fps, adaptive first so a late
+    // frame tears instead of waiting out a whole refresh. Without it the
+    // pacer holds the display's refresh rate.
+    state.vsync = 0;
+    if(!state.headless && state.targetFPS < 0){
+        if(SDL_SetRenderVSync(state.renderer, SDL_RENDERER_VSYNC_ADAPTIVE)) state.vsync = SDL_RENDERER_VSYNC_ADAPTIVE;
+        else if(SDL_SetRenderVSync(state.renderer, 1)) state.vsync = 1;
+    }
+    if(state.vsync == 0){
+        int fps = state.targetFPS;
+        if(fps < 0 && state.headless) fps = 0;
+        else if(fps < 0){
+            const SDL_DisplayMode *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(state.window));
+            fps = (mode && mode->refresh_rate > 0.0f) ? static_cast<int>(SDL_roundf(mode->refresh_rate)) : DEFAULT_FPS;
+        }
+        if(!state.headless) SDL_SetRenderVSync(state.renderer, 0);
+        state.pacer.setTarget(fps);
+    }
     SDL_SetRenderLogicalPresentation(state.renderer, state.logW, state.logH, SDL_LOGICAL_PRESENTATION_LETTERBOX);
     return success;
 }
 
-void DrawObj(const SDLState &state, GameState &gs, GameObject &obj, float width, float height, float timeDelta){
-    float srcX = (obj.curAnimation != -1) ? obj.animations[obj.curAnimation].curFrame() * width : (obj.spriteFrame - 1) * width;
+void DrawObj(const SDLState &state, RenderState &rs, const Resource &res, const SpriteSnapshot &obj, float alpha){
+    // Draw between the last two simulated positions
+    const glm::vec2 pos = glm::mix(obj.prevPos, obj.pos, alpha);
+    float srcX = obj.frame * obj.width;
     SDL_FRect from{
-        .x = srcX, .y = 0, .w = width, .h = height
+        .x = srcX, .y = 0, .w = obj.width, .h = obj.height
     };
     SDL_FRect to{
-        .x = obj.pos.x - gs.MapViewport.x, .y = obj.pos.y, .w = width, .h = height
+        .x = pos.x - rs.MapViewport.x, .y = pos.y, .w = obj.width, .h = obj.height
     };
     SDL_FlipMode flipH = (obj.dir == -1) ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
-    if(!obj.flashes){
-        SDL_RenderTextureRotated(state.renderer, obj.texture, &from, &to, 0.0f, nullptr, flipH);
+    // A hit flash is a tint on the sprite's own vertices, so flashing sprites
+    // stay in the same batch as everything else
+    const SDL_FColor tint = obj.flashes ? HIT_FLASH_TINT : SDL_FColor{1.0f, 1.0f, 1.0f, 1.0f};
+    const AtlasEntry *sprite = res.atlas.find(obj.texture);
+    if(sprite){
+        rs.batch.add(obj.layer, res.atlas.page(sprite->page), res.atlas.frameRect(*sprite, obj.frame, obj.dir == -1), to, tint);
     }
     else{
-        SDL_SetTextureColorModFloat(obj.texture, 2.5f, 1.0f, 1.0f);
+        rs.batch.flush(state.renderer);
+        SDL_SetTextureColorModFloat(obj.texture, tint.r, tint.g, tint.b);
         SDL_RenderTextureRotated(state.renderer, obj.texture, &from, &to, 0.0f, nullptr, flipH);
         SDL_SetTextureColorModFloat(obj.texture, 1.0f, 1.0f, 1.0f);
-        if(obj.flashTimer.step(timeDelta)){
-            obj.flashes = false;
+    }
+}
+
+// Debug overlay for the sprites' hitboxes, drawn once the sprite batch is
+// flushed so the sprites still go out in as few draw calls as ever
+void DrawHitboxes(const SDLState &state, const RenderState &rs, const RenderSnapshot &snap, float alpha){
+    SDL_SetRenderDrawBlendMode(state.renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(state.renderer, 255, 0, 0, 150);
+    for(const SpriteSnapshot &sprite : snap.sprites){
+        const glm::vec2 pos = glm::mix(sprite.prevPos, sprite.pos, alpha);
+        SDL_FRect rect{
+            .x = pos.x + sprite.hitbox.x - rs.MapViewport.x,
+            .y = pos.y + sprite.hitbox.y,
+            .w = sprite.hitbox.w,
+            .h = sprite.hitbox.h
+        };
+        SDL_RenderFillRect(state.renderer, &rect);
+    }
+    SDL_SetRenderDrawBlendMode(state.renderer, SDL_BLENDMODE_NONE);
+}
+
+// One fixed step: the input that came in since the last one, then the world
+void Tick(const SDLState &state, GameState &gs, Resource &res, SimLink &link){
+    {
+        std::lock_guard<std::mutex> lock(link.inputLock);
+        gs.pendingInput.swap(link.input);
+    }
+    for(const InputEvent &input : gs.pendingInput){
+        if(input.key < 0 || input.key >= SDL_SCANCODE_COUNT) continue;
+        gs.keys[input.key] = input.pressed;
+        HandleKey(state, gs, gs.getPlayer(), input.key, input.pressed);
+    }
+    gs.pendingInput.clear();
+    simulate(state, gs, res, SIM_STEP);
+    GameObject &player = gs.getPlayer();
+    if(player.data.player.state == PlayerState::jumping && player.grounded){
+        player.data.player.state = PlayerState::idle;
+    }
+    // The simulation's own camera, for what it keeps active and culls
+    gs.MapViewport.x = player.pos.x + TILE_SIZE / 2 - state.logW / 2;
+}
+
+// Copies out what drawing needs. Culling starts here, against the camera
+// the last tick left, because the broadphase belongs to the simulation.
+void TakeSnapshot(GameState &gs, RenderSnapshot &snap){
+    const SDL_FRect drawRegion{
+        .x = gs.MapViewport.x - CULL_MARGIN,
+        .y = gs.MapViewport.y - CULL_MARGIN,
+        .w = gs.MapViewport.w + CULL_MARGIN * 2,
+        .h = gs.MapViewport.h + CULL_MARGIN * 2
+    };
+    const auto add = [&snap](const GameObject &obj, float width, float height, int layer){
+        snap.sprites.push_back(SpriteSnapshot{
+            obj.texture, obj.prevPos, obj.pos, obj.hitbox, width, height, obj.dir,
+            CurrentFrame(obj), layer, obj.flashes
+        });
+    };
+    snap.sprites.clear();
+    snap.culled = 0;
+    // Handles sort by layer, then index, so this keeps the usual draw order
+    gs.broadphase->query(drawRegion, gs.visible);
+    for(uint32_t handle : gs.visible){
+        add(gs.getBody(handle), TILE_SIZE, TILE_SIZE, DRAW_CHARACTERS);
+    }
+    for(auto &layer : gs.layers){
+        snap.culled += static_cast<int>(layer.size());
+    }
+    snap.culled -= static_cast<int>(gs.visible.size());
+    for(const GameObject &gb : gs.Bullets){
+        if(gb.data.bullet.state == BulletState::idle) continue;
+        const SDL_FRect sprite{gb.pos.x, gb.pos.y, gb.hitbox.w, gb.hitbox.h};
+        if(SDL_HasRectIntersectionFloat(&sprite, &drawRegion)) add(gb, gb.hitbox.w, gb.hitbox.h, DRAW_BULLETS);
+        else snap.culled++;
+    }
+
+    const GameObject &player = gs.getPlayer();
+    snap.playerPrevPos = player.prevPos;
+    snap.playerPos = player.pos;
+    snap.playerVelX = player.vel.x;
+    snap.hp = player.data.player.HP;
+    snap.hpMax = player.data.player.HPmax;
+    snap.playerState = static_cast<int>(player.data.player.state);
+    snap.bullets = static_cast<int>(gs.Bullets.size());
+    snap.grounded = player.grounded;
+    snap.idleBullets = 0;
+    snap.bulletX = snap.viewX = 0.0f;
+    if(gs.Bullets.size() && gs.Bullets[0].data.bullet.state == BulletState::idle){
+        snap.idleBullets = 1;
+        snap.bulletX = gs.Bullets[0].pos.x;
+        snap.viewX = gs.MapViewport.x;
+    }
+
+    // Tile edits go out as a fresh read-only copy of the map, with its
+    // colliders built first so the copy never has to rebuild them
+    if(gs.tiles.takeChanges(gs.tileChangedC0, gs.tileChangedC1)){
+        gs.tiles.getColliders();
+        gs.tileView = std::make_shared<const TileMap>(gs.tiles);
+        gs.tileVersion++;
+    }
+    snap.tiles = gs.tileView;
+    snap.tilesVersion = gs.tileVersion;
+    snap.tilesC0 = gs.tileChangedC0;
+    snap.tilesC1 = gs.tileChangedC1;
+}
+
+// The simulation thread. Ticks follow the wall clock at SIM_STEP and a
+// snapshot goes out after every batch of them, so drawing never waits on
+// the simulation and presenting never holds up a tick.
+void RunSimulation(const SDLState &state, GameState &gs, Resource &res, SimLink &link){
+    uint64_t nextTick = SDL_GetTicksNS() + SIM_STEP_NS;
+    while(link.running.load(std::memory_order_relaxed)){
+        if(link.paused.load(std::memory_order_relaxed)){
+            // Start counting again from whenever the pause ends
+            SDL_DelayNS(SDL_MS_TO_NS(IDLE_WAIT_MS));
+            nextTick = SDL_GetTicksNS() + SIM_STEP_NS;
+            continue;
         }
+        const uint64_t now = SDL_GetTicksNS();
+        if(now < nextTick){
+            SDL_DelayPrecise(nextTick - now);
+            continue;
+        }
+        int steps = 0;
+        while(now >= nextTick && steps < MAX_SIM_STEPS){
+            Tick(state, gs, res, link);
+            nextTick += SIM_STEP_NS;
+            steps++;
+        }
+        // Give up on catching up after a long hitch
+        if(now >= nextTick) nextTick = now + SIM_STEP_NS;
+        RenderSnapshot &snap = link.snapshots.writeBuffer();
+        TakeSnapshot(gs, snap);
+        snap.dueNS = nextTick - SIM_STEP_NS;
+        link.snapshots.publish();
+    }
+}
 
+void simulate(const SDLState &state, GameState &gs, Resource &res, float timeDelta){
+    gs.contacts.beginTick();
+    // Only bodies around the camera are simulated, so a tick costs the same
+    // however long the level is. Anything further out stays frozen in place.
+    gs.activeRegion = SDL_FRect{
+        .x = gs.MapViewport.x - gs.MapViewport.w * ACTIVE_REGION_SCREENS,
+        .y = gs.MapViewport.y - gs.MapViewport.h * ACTIVE_REGION_SCREENS,
+        .w = gs.MapViewport.w * (2 * ACTIVE_REGION_SCREENS + 1),
+        .h = gs.MapViewport.h * (2 * ACTIVE_REGION_SCREENS + 1)
+    };
+    gs.broadphase->query(gs.activeRegion, gs.active);
+    WakeNearPlayer(gs);
+
+    // Move everything first...
+    for(uint32_t handle : gs.active){
+        GameObject &obj = gs.getBody(handle);
+        if(obj.body == BodyType::staticBody) continue;
+        obj.prevPos = obj.pos;
+        if(obj.sleeping){
+            // Asleep isn't frozen: idle animations keep playing
+            if(obj.curAnimation != -1) obj.animations[obj.curAnimation].step(timeDelta);
+            continue;
+        }
+        update(state, gs, obj, res, timeDelta, state.engine);
+        gs.collisionRules.classify(obj);
+        gs.broadphase->move(obj.handle, hitboxRect(obj));
     }
-        if(gs.debugMode){
-        SDL_FRect rectA{
-        .x = obj.pos.x + obj.hitbox.x - gs.MapViewport.x,
+    for(GameObject &bullet : gs.Bullets){
+        bullet.prevPos = bullet.pos;
+        update(state, gs, bullet, res, timeDelta, state.engine);
+        gs.collisionRules.classify(bullet);
+    }
+
+    // ...then find the contacts, visiting every pair once...
+    for(uint32_t handle : gs.active){
+        GameObject &obj = gs.getBody(handle);
+        if(IsSimulated(gs, obj)) FindContacts(state, gs, obj, res, timeDelta);
+    }
+    for(GameObject &bullet : gs.Bullets){
+        // Pooled bullets waiting to be fired touch nothing, and any pair one
+        // still had exits at the end of the tick
+        if(bullet.data.bullet.state == BulletState::idle) continue;
+        FindContacts(state, gs, bullet, res, timeDelta);
+    }
+
+    // ...and settle who stands on what once everyone is where they end up
+    for(uint32_t handle : gs.active){
+        GameObject &obj = gs.getBody(handle);
+        if(IsSimulated(gs, obj) && obj.hasGravity) ProbeGround(gs, obj);
+    }
+
+    // A contact nobody could have tested this tick is still there
+    const auto generates = [&gs](uint32_t handle){
+        const int layer = handleLayer(handle);
+        return layer == BULLET_HANDLES || (layer < TILE_HANDLES && IsSimulated(gs, gs.getBody(handle)));
+    };
+    gs.contacts.endTick([&generates](uint32_t a, uint32_t b){
+        return !generates(a) && !generates(b);
+    }, [&gs](uint32_t a, uint32_t b){
+        OnContactExit(gs, gs.getBody(a), gs.getBody(b));
+        OnContactExit(gs, gs.getBody(b), gs.getBody(a));
+    });
+
+    // Sleep and wake only now, so every body kept the same state for the
+    // whole tick and the pair ownership above stayed consistent
+    for(uint32_t handle : gs.active){
+        GameObject &obj = gs.getBody(handle);
+        if(IsSimulated(gs, obj) && CanSleep(obj)) obj.sleeping = true;
+    }
+    for(uint32_t handle : gs.woken){
+        gs.getBody(handle).sleeping = false;
+    }
+    gs.woken.clear();
+}
+
+// Whether obj is integrated and runs its own contact pass this tick
+bool IsSimulated(const GameState &gs, const GameObject &obj){
+    return obj.body == BodyType::dynamicBody && !obj.sleeping &&
+           std::binary_search(gs.active.begin(), gs.active.end(), obj.handle);
+}
+
+// Enemies with nothing to do: shambling with the player out of reach, or
+// dead and done dying. The player never sleeps.
+bool CanSleep(const GameObject &obj){
+    if(obj.type != ObjectType::enemy || !obj.grounded || obj.flashes || obj.vel != glm::vec2(0)) return false;
+    if(!obj.data.enemy.hitRate.isTmOut()) return false; // its cooldown would stop
+    switch(obj.data.enemy.state){
+        case enemyState::shambling:
+            return obj.acc == glm::vec2(0);
+        case enemyState::dead:
+            return obj.curAnimation == -1;
+        default:
+            return false;
+    }
+}
+
+// Closest hit along origin + dir * t for 0 <= t <= maxDist: level tiles if
+// mask has COLLIDE_LEVEL, and the hitboxes of bodies whose layer is in mask,
+// apart from ignore. The tiles are walked first, so the body query only
+// has to cover the stretch of ray in front of the first wall.
+bool Raycast(GameState &gs, glm::vec2 origin, glm::vec2 dir, float maxDist, uint32_t mask, const GameObject *ignore, RayHit &hit){
+    const float len = glm::length(dir);
+    if(len == 0.0f) return false;
+    dir = dir / len;
+    hit.target = nullptr;
+    hit.distance = maxDist;
+    bool found = (mask & COLLIDE_LEVEL) && gs.tiles.raycast(origin, dir, maxDist, hit.distance, hit.normal);
+    const glm::vec2 end = origin + dir * hit.distance;
+    const SDL_FRect span{
+        .x = std::min(origin.x, end.x),
+        .y = std::min(origin.y, end.y),
+        .w = std::abs(end.x - origin.x),
+        .h = std::abs(end.y - origin.y)
+    };
+    gs.broadphase->query(span, gs.nearby);
+    for(uint32_t handle : gs.nearby){
+        GameObject &other = gs.getBody(handle);
+        if(&other == ignore || !(mask & other.collisionLayer)) continue;
+        float dist;
+        glm::vec2 normal;
+        if(rayAABB(origin, dir, hit.distance, hitboxRect(other), dist, normal) && (!found || dist < hit.distance)){
+            found = true;
+            hit.target = &other;
+            hit.distance = dist;
+            hit.normal = normal;
+        }
+    }
+    hit.point = origin + dir * hit.distance;
+    return found;
+}
+
+// Whether the level leaves a clear line between the middles of the two
+// hitboxes. Other characters don't block the view.
+bool HasLineOfSight(GameState &gs, const GameObject &from, const GameObject &to){
+    const SDL_FRect a = hitboxRect(from), b = hitboxRect(to);
+    const glm::vec2 eye(a.x + a.w / 2, a.y + a.h / 2), target(b.x + b.w / 2, b.y + b.h / 2);
+    RayHit hit;
+    return !Raycast(gs, eye, target - eye, glm::length(target - eye), COLLIDE_LEVEL, &from, hit);
+}
+
+// Sleeping enemies have to notice the player walking up to them before they
+// are touched, or they would never start chasing. They wake on the same
+// terms update() starts a chase on, or CanSleep would put them straight back.
+void WakeNearPlayer(GameState &gs){
+    const GameObject &player = gs.getPlayer();
+    const SDL_FRect reach{
+        .x = player.pos.x - ENEMY_AGGRO_RANGE,
+        .y = player.pos.y - ENEMY_AGGRO_RANGE,
+        .w = ENEMY_AGGRO_RANGE * 2,
+        .h = ENEMY_AGGRO_RANGE * 2
+    };
+    gs.broadphase->query(reach, gs.nearby);
+    // The line of sight test queries the broadphase too, so pick the
+    // candidates out of gs.nearby first
+    gs.inAggroRange.clear();
+    for(uint32_t handle : gs.nearby){
+        const GameObject &obj = gs.getBody(handle);
+        if(obj.sleeping && obj.type == ObjectType::enemy && obj.data.enemy.state == enemyState::shambling &&
+           glm::length(player.pos - obj.pos) < ENEMY_AGGRO_RANGE) gs.inAggroRange.push_back(handle);
+    }
+    for(uint32_t handle : gs.inAggroRange){
+        GameObject &obj = gs.getBody(handle);
+        if(HasLineOfSight(gs, obj, player)) obj.sleeping = false;
+    }
+}
+
+SDL_FRect hitboxRect(const GameObject &obj){
+    return SDL_FRect{
+        .x = obj.pos.x + obj.hitbox.x,
         .y = obj.pos.y + obj.hitbox.y,
         .w = obj.hitbox.w,
         .h = obj.hitbox.h
-        };
-        SDL_SetRenderDrawBlendMode(state.renderer, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderDrawColor(state.renderer, 255, 0, 0, 150);
-        SDL_RenderFillRect(state.renderer, &rectA);
-        //SDL_RenderFillRect(state.renderer, &gs.MapViewport);
-        SDL_SetRenderDrawBlendMode(state.renderer, SDL_BLENDMODE_NONE);
+    };
+}
+
+// Index of the sprite sheet frame obj is showing
+int CurrentFrame(const GameObject &obj){
+    return (obj.curAnimation != -1) ? obj.animations[obj.curAnimation].curFrame() : obj.spriteFrame - 1;
+}
+
+// Hitboxes are what characters stand and push on, but a bullet only hits
+// when it lands on the sprite
+bool NeedsPixelTest(const GameObject &a, const GameObject &b){
+    const auto isCharacter = [](const GameObject &obj){
+        return obj.type == ObjectType::player || obj.type == ObjectType::enemy;
+    };
+    return (a.type == ObjectType::bullet && isCharacter(b)) || (b.type == ObjectType::bullet && isCharacter(a));
+}
+
+// Second narrowphase stage, once the AABBs are known to touch: do the frames
+// as drawn at posA and posB share an opaque pixel? Anything without a mask
+// counts as solid.
+bool PixelsOverlap(const Resource &res, const GameObject &a, glm::vec2 posA, const GameObject &b, glm::vec2 posB){
+    const SpriteMask *maskA = res.getMask(a.texture), *maskB = res.getMask(b.texture);
+    if(!maskA || !maskB) return true;
+    return masksOverlap(maskA->frame(CurrentFrame(a), a.dir == -1), maskA->size(), glm::ivec2(glm::round(posA)),
+                        maskB->frame(CurrentFrame(b), b.dir == -1), maskB->size(), glm::ivec2(glm::round(posB)));
+}
+
+// Pixel test for a swept hit: from the time of impact of the boxes, walk
+// the rest of the path a pixel at a time until the sprites overlap or the
+// boxes come apart again. Moves toi up to the first pixel contact.
+bool SweepPixels(const Resource &res, const GameObject &obj, glm::vec2 delta, const GameObject &other, const SDL_FRect &otherRect, float &toi){
+    const float length = std::max(std::abs(delta.x), std::abs(delta.y)) * (1.0f - toi);
+    const int steps = std::max(static_cast<int>(std::ceil(length)), 1);
+    const SDL_FRect from = hitboxRect(obj);
+    for(int i = 0; i <= steps; i++){
+        const float t = toi + (1.0f - toi) * i / steps;
+        const SDL_FRect rect{from.x + delta.x * t, from.y + delta.y * t, from.w, from.h};
+        if(!rectsTouch(rect, otherRect)) break;
+        if(PixelsOverlap(res, obj, obj.pos + delta * t, other, other.pos)){
+            toi = t;
+            return true;
+        }
     }
+    return false;
 }
 
 void update(const SDLState &state, GameState &gs,GameObject &obj, Resource &res, float timeDelta, ma_engine engine){
     if(obj.curAnimation != -1) obj.animations[obj.curAnimation].step(timeDelta);
-    if(obj.dynamic && !obj.grounded) obj.vel += glm::vec2(0, 400) * timeDelta; // gravity
+    if(obj.flashes && obj.flashTimer.step(timeDelta)) obj.flashes = false;
+    if(obj.hasGravity && !obj.grounded) obj.vel += glm::vec2(0, 400) * timeDelta; // gravity
     float curDir = 0;
     if(obj.type == ObjectType::player){
-        if(state.keys[SDL_SCANCODE_A]){
+        if(gs.keys[SDL_SCANCODE_A]){
             curDir += -1;
         }
-        if(state.keys[SDL_SCANCODE_D]){
+        if(gs.keys[SDL_SCANCODE_D]){
             curDir += 1;
         }
-        if(state.keys[SDL_SCANCODE_ESCAPE]) exit(EXIT_SUCCESS);
         Timer &weaponTimer = obj.data.player.WeaponTimer;
         weaponTimer.step(timeDelta);
         const auto handleShooting = [&state, &gs, &res, &obj, &weaponTimer, &engine](SDL_Texture *tex, SDL_Texture *shootTex, int AnimIndex, int ShootAnimIndex){
-            if(state.keys[SDL_SCANCODE_RCTRL]){
+            if(gs.keys[SDL_SCANCODE_RCTRL]){
                 obj.texture = shootTex;
                 obj.curAnimation = ShootAnimIndex;
                 if(weaponTimer.isTmOut()){
@@ -425,6 +1151,7 @@ void update(const SDLState &state, GameState &gs,GameObject &obj, Resource &res,
                     const float yVel = SDL_rand(yVar) - yVar/2.0f;
                     bullet.vel = glm::vec2((obj.vel.x + 600.0f) * obj.dir , yVel);
                     bullet.type = ObjectType::bullet;
+                    bullet.body = BodyType::dynamicBody;
                     bullet.dir = gs.getPlayer().dir;
                     bullet.texture = res.bulletTex;
                     bullet.maxSpeedX = 1000.0f;
@@ -444,14 +1171,20 @@ void update(const SDLState &state, GameState &gs,GameObject &obj, Resource &res,
                         obj.pos.x + xOffset,
                         obj.pos.y + TILE_SIZE / 2 + 1
                     };
+                    bullet.prevPos = bullet.pos;
+                    gs.collisionRules.classify(bullet);
                     bool foundIdle = false;
                     for(int i = 0; i < gs.Bullets.size() && !foundIdle; i++){
                         if(gs.Bullets[i].data.bullet.state == BulletState::idle){
                             foundIdle = true;
+                            bullet.handle = makeHandle(BULLET_HANDLES, i);
                             gs.Bullets[i] = bullet;
                         }
                     }
-                    if(!foundIdle) gs.Bullets.push_back(bullet);
+                    if(!foundIdle){
+                        bullet.handle = makeHandle(BULLET_HANDLES, static_cast<int>(gs.Bullets.size()));
+                        gs.Bullets.push_back(bullet);
+                    }
                     ma_engine_play_sound(&engine, "resources/sound/shoot.wav", NULL);
                 }
             }
@@ -520,11 +1253,12 @@ void update(const SDLState &state, GameState &gs,GameObject &obj, Resource &res,
         }
     }
     else if(obj.type == ObjectType::enemy){
+        obj.data.enemy.coolDown(timeDelta);
         switch(obj.data.enemy.state){
             case enemyState::shambling:
             {
                 glm::vec2 playerDir = gs.getPlayer().pos - obj.pos;
-                if(glm::length(playerDir) < 100){
+                if(glm::length(playerDir) < ENEMY_AGGRO_RANGE && HasLineOfSight(gs, obj, gs.getPlayer())){
                     curDir = playerDir.x < 0 ? -1 : 1;
                     obj.acc = glm::vec2(30, 0);
                 }
@@ -545,7 +1279,6 @@ void update(const SDLState &state, GameState &gs,GameObject &obj, Resource &res,
             case enemyState::dead:
             {
                 obj.vel = glm::vec2(0);
-                obj.hitbox = SDL_FRect{-1, -1, -1, -1};
                 if(obj.curAnimation != -1 && obj.animations[obj.curAnimation].done()){
                     obj.spriteFrame = 18;
                     obj.curAnimation = -1;
@@ -558,31 +1291,74 @@ void update(const SDLState &state, GameState &gs,GameObject &obj, Resource &res,
     }
     obj.vel += obj.acc * curDir * timeDelta;
     if(std::abs(obj.vel.x) > obj.maxSpeedX) obj.vel.x = obj.maxSpeedX * curDir;
-    obj.pos += obj.vel * timeDelta;
-    bool foundGround = false;
-    for(auto &layer : gs.layers){
-        for(GameObject &other : layer){
-            if(&other != &obj){
-                CollisionDetection(state, gs, obj, other, timeDelta, res);
-                
-                SDL_FRect sensor{
-                    .x = obj.pos.x + obj.hitbox.x,
-                    .y = obj.pos.y + obj.hitbox.y + obj.hitbox.h,
-                    .w = obj.hitbox.w,
-                    .h = 1
-                };
-                SDL_FRect otherRect{
-                    .x = other.pos.x + other.hitbox.x,
-                    .y = other.pos.y + other.hitbox.y,
-                    .w = other.hitbox.w,
-                    .h = other.hitbox.h
-                };
-                SDL_FRect intersect{0};
-                if(SDL_GetRectIntersectionFloat(&sensor, &otherRect, &intersect)){
-                    if(intersect.h < intersect.w)
-                    foundGround = true;
-                }
-            }
+    const glm::vec2 delta = obj.vel * timeDelta;
+    // A bullet covering more than its own size in one tick could step over a
+    // thin target, so it gets swept instead of just tested where it lands
+    if(obj.type == ObjectType::bullet && obj.data.bullet.state == BulletState::moving &&
+       (std::abs(delta.x) > obj.hitbox.w || std::abs(delta.y) > obj.hitbox.h)){
+        if(SweepBullet(state, gs, obj, res, delta, timeDelta)) return;
+    }
+    obj.pos += delta;
+}
+
+// Contact pass for one body, run after every body has moved. Pairs between
+// two simulated bodies are only generated from the lower handle's side;
+// bullets aren't in the broadphase, so they pick up their pairs themselves.
+void FindContacts(const SDLState &state, GameState &gs, GameObject &obj, Resource &res, float timeDelta){
+    // Only look at tiles and bodies near the hitbox. The reach is padded by
+    // the hitbox size since responses below can push obj around mid-loop.
+    SDL_FRect reach = hitboxRect(obj);
+    reach.x -= obj.hitbox.w;
+    reach.y -= obj.hitbox.h;
+    reach.w += obj.hitbox.w * 2;
+    reach.h += obj.hitbox.h * 2 + 1;
+    gs.candidates.clear();
+    gs.candidateHandles.clear();
+    if(obj.collisionMask & COLLIDE_LEVEL){
+        const auto addTile = [&gs](uint32_t handle, const SDL_FRect &collider){
+            gs.candidates.push(collider);
+            gs.candidateHandles.push_back(handle);
+        };
+        if(!gs.contacts.revalidateTiles(obj.handle, hitboxRect(obj), gs.tiles.getLevelVersion(), addTile)){
+            gs.tiles.forEachCollider(reach, [&](const SDL_FRect &collider, int idx){
+                addTile(makeHandle(TILE_HANDLES, idx), collider);
+            });
+        }
+    }
+    const bool inBroadphase = handleLayer(obj.handle) < TILE_HANDLES;
+    gs.broadphase->query(reach, gs.nearby);
+    for(uint32_t handle : gs.nearby){
+        if(handle == obj.handle) continue;
+        GameObject &other = gs.layers[handleLayer(handle)][handleIdx(handle)];
+        // A body that sleeps or lies outside the active region won't look
+        // for this pair itself, whatever its handle
+        if(inBroadphase && handle < obj.handle && IsSimulated(gs, other)) continue;
+        if(!(obj.collisionMask & other.collisionLayer) && !(other.collisionMask & obj.collisionLayer)) continue;
+        gs.candidates.push(hitboxRect(other));
+        gs.candidateHandles.push_back(handle);
+    }
+    ResolveContacts(state, gs, obj, res, timeDelta);
+}
+
+// Ground probe: a 1px strip under the feet, checked against the solid
+// tiles and then against whoever else is standing around
+void ProbeGround(GameState &gs, GameObject &obj){
+    SDL_FRect sensor{
+        .x = obj.pos.x + obj.hitbox.x,
+        .y = obj.pos.y + obj.hitbox.y + obj.hitbox.h,
+        .w = obj.hitbox.w,
+        .h = 1
+    };
+    bool foundGround = (obj.collisionMask & COLLIDE_LEVEL) && gs.tiles.anyGround(sensor);
+    if(!foundGround) gs.broadphase->query(sensor, gs.nearby);
+    for(int i = 0; i < gs.nearby.size() && !foundGround; i++){
+        GameObject &other = gs.layers[handleLayer(gs.nearby[i])][handleIdx(gs.nearby[i])];
+        if(&other == &obj || !(obj.collisionMask & other.collisionLayer)) continue;
+        SDL_FRect otherRect = hitboxRect(other);
+        SDL_FRect intersect{0};
+        if(SDL_GetRectIntersectionFloat(&sensor, &otherRect, &intersect)){
+            if(intersect.h < intersect.w)
+            foundGround = true;
         }
     }
     if(foundGround != obj.grounded){
@@ -626,7 +1402,6 @@ void CollisionResponse(const SDLState &state, Resource &res, GameState &gs, Game
                 genericResponse();
                 break;
             case ObjectType::enemy:
-            if(b.data.enemy.hitRate.step(timeDelta)) a.data.player.HP -= 10; 
                 genericResponse();
                 break;
         }
@@ -678,32 +1453,139 @@ void CollisionResponse(const SDLState &state, Resource &res, GameState &gs, Game
     else if(a.type == ObjectType::enemy){
         genericResponse();
     }
+    // Bullets land and enemies die in here, which moves them to another layer
+    gs.collisionRules.classify(a);
+    if(&b != &gs.tileBody) gs.collisionRules.classify(b);
 }
     
 
-void CollisionDetection(const SDLState &state, GameState &gs, GameObject &a, GameObject &b, float timeDelta, Resource &res){
-    SDL_FRect rectA{
-        .x = a.pos.x + a.hitbox.x,
-        .y = a.pos.y + a.hitbox.y,
-        .w = a.hitbox.w,
-        .h = a.hitbox.h
-    };
-    SDL_FRect rectB{
-        .x = b.pos.x + b.hitbox.x,
-        .y = b.pos.y + b.hitbox.y,
-        .w = b.hitbox.w,
-        .h = b.hitbox.h
+// Narrowphase for obj against gs.candidates. Overlaps are found in batches,
+// but a response that moves obj invalidates the rest of the batch, so the
+// kernel is rerun from the next candidate with the new hitbox. That keeps the
+// results identical to testing each candidate one after another.
+//
+// Each overlap is resolved for both sides: obj responds first, then the
+// other body responds to whatever overlap is left, so the pair is never
+// pushed apart twice.
+void ResolveContacts(const SDLState &state, GameState &gs, GameObject &obj, Resource &res, float timeDelta){
+    SDL_FRect rectA = hitboxRect(obj);
+    bool settled = true;
+    gs.tileContacts.clear();
+    gs.tileContactRects.clear();
+    int next = 0;
+    while(next < gs.candidates.size()){
+        gs.hits.clear();
+        intersectBatch(rectA, gs.candidates, next, gs.hits);
+        next = gs.candidates.size();
+        for(const BoxHit &hit : gs.hits){
+            const uint32_t handle = gs.candidateHandles[hit.idx];
+            GameObject &other = gs.getBody(handle);
+            if(NeedsPixelTest(obj, other) && !PixelsOverlap(res, obj, obj.pos, other, other.pos)) continue;
+            const SDL_FRect rectB = gs.candidates.rect(hit.idx);
+            const bool isTile = handleLayer(handle) == TILE_HANDLES;
+            if(isTile){
+                gs.tileBody.pos = glm::vec2(rectB.x, rectB.y);
+                gs.tileBody.hitbox = SDL_FRect{0, 0, rectB.w, rectB.h};
+                gs.tileContacts.push_back(handle);
+                gs.tileContactRects.push_back(rectB);
+                // genericResponse pushes along the thinner side of the overlap
+                const bool touching = (hit.intersect.w < hit.intersect.h) ? hit.intersect.w == 0 : hit.intersect.h == 0;
+                if(!touching) settled = false;
+            }
+            if(other.sleeping) gs.woken.push_back(handle);
+            const ContactEvent event = gs.contacts.record(SDL_min(obj.handle, handle), SDL_max(obj.handle, handle), hit.intersect);
+            if(event == ContactEvent::enter){
+                OnContactEnter(gs, obj, other);
+                OnContactEnter(gs, other, obj);
+            }
+            else{
+                OnContactStay(gs, obj, other, timeDelta);
+                OnContactStay(gs, other, obj, timeDelta);
+            }
+            if(obj.collisionMask & other.collisionLayer){
+                CollisionResponse(state, res, gs, obj, other, rectA, rectB, hit.intersect, timeDelta, state.engine);
+            }
+            if(!isTile && (other.collisionMask & obj.collisionLayer)){
+                const SDL_FRect rectObj = hitboxRect(obj);
+                SDL_FRect intersect;
+                if(SDL_GetRectIntersectionFloat(&rectB, &rectObj, &intersect)){
+                    CollisionResponse(state, res, gs, other, obj, rectB, rectObj, intersect, timeDelta, state.engine);
+                    gs.broadphase->move(other.handle, hitboxRect(other));
+                }
+            }
+            const SDL_FRect moved = hitboxRect(obj);
+            if(SDL_memcmp(&moved, &rectA, sizeof(SDL_FRect)) != 0){
+                rectA = moved;
+                settled = false;
+                if(handleLayer(obj.handle) < TILE_HANDLES) gs.broadphase->move(obj.handle, rectA);
+                next = hit.idx + 1;
+                break;
+            }
+        }
+    }
+    gs.contacts.settle(obj.handle, rectA, gs.tiles.getLevelVersion(), gs.tileContacts, gs.tileContactRects, settled);
+}
+
+void OnContactEnter(GameState &gs, GameObject &a, GameObject &b){
+    ContactDamage(a, b);
+}
+
+void OnContactStay(GameState &gs, GameObject &a, GameObject &b, float timeDelta){
+    ContactDamage(a, b);
+}
+
+void OnContactExit(GameState &gs, GameObject &a, GameObject &b){
+    // Nothing to undo: the enemy's hitRate keeps counting down in update()
+}
+
+bool SweepBullet(const SDLState &state, GameState &gs, GameObject &obj, Resource &res, glm::vec2 delta, float timeDelta){
+    const SDL_FRect from = hitboxRect(obj);
+    const SDL_FRect path{
+        .x = std::min(from.x, from.x + delta.x),
+        .y = std::min(from.y, from.y + delta.y),
+        .w = from.w + std::abs(delta.x),
+        .h = from.h + std::abs(delta.y)
     };
-    SDL_FRect intersect{0};
-    if(gs.debugMode){
-        SDL_SetRenderDrawBlendMode(state.renderer, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderDrawColor(state.renderer, 0, 255, 0, 150);
-        SDL_RenderFillRect(state.renderer, &intersect);
-        //SDL_RenderFillRect(state.renderer, &gs.MapViewport);
-        SDL_SetRenderDrawBlendMode(state.renderer, SDL_BLENDMODE_NONE);
+    float first = 2.0f;
+    glm::vec2 normal;
+    SDL_FRect targetRect{0};
+    GameObject *target = nullptr;
+    if(obj.collisionMask & COLLIDE_LEVEL){
+        gs.tiles.forEachCollider(path, [&](const SDL_FRect &collider, int idx){
+            float toi;
+            if(sweepAABB(from, delta, collider, toi, normal) && toi < first){
+                first = toi;
+                targetRect = collider;
+                target = &gs.tileBody;
+            }
+        });
     }
-    if(SDL_GetRectIntersectionFloat(&rectA, &rectB, &intersect)) CollisionResponse(state, res, gs, a, b, rectA, rectB, intersect, timeDelta, state.engine);
+    gs.broadphase->query(path, gs.nearby);
+    for(uint32_t handle : gs.nearby){
+        GameObject &other = gs.layers[handleLayer(handle)][handleIdx(handle)];
+        if(!(obj.collisionMask & other.collisionLayer)) continue;
+        const SDL_FRect otherRect = hitboxRect(other);
+        float toi;
+        if(!sweepAABB(from, delta, otherRect, toi, normal) || toi >= first) continue;
+        if(NeedsPixelTest(obj, other) && !SweepPixels(res, obj, delta, other, otherRect, toi)) continue;
+        if(toi < first){
+            first = toi;
+            targetRect = otherRect;
+            target = &other;
+        }
+    }
+    if(!target) return false;
 
+    if(target == &gs.tileBody){
+        gs.tileBody.pos = glm::vec2(targetRect.x, targetRect.y);
+        gs.tileBody.hitbox = SDL_FRect{0, 0, targetRect.w, targetRect.h};
+    }
+    // Like any other contact, a hit wakes whoever it lands on
+    if(target->sleeping) gs.woken.push_back(target->handle);
+    obj.pos += delta * first;
+    const SDL_FRect rectA = hitboxRect(obj);
+    CollisionResponse(state, res, gs, obj, *target, rectA, targetRect, contactRect(rectA, targetRect), timeDelta, state.engine);
+    return true;
 }
 
 void createTiles(const SDLState &state, GameState &gs, Resource &res){
@@ -738,12 +1620,20 @@ void createTiles(const SDLState &state, GameState &gs, Resource &res){
 		5, 5, 5, 5, 5, 5, 5, 0, 0, 0, 0, 0, 0, 0, 0, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
 		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
     };
-    const auto loadMap = [&state, &res, &gs](short layer[MAX_ROWS][MAX_COLS]){
+    gs.tiles.reset(MAX_ROWS, MAX_COLS, TILE_SIZE, glm::vec2(0, state.logH - MAX_ROWS * TILE_SIZE));
+    const uint8_t groundTile = gs.tiles.addType(res.groundTex, true);
+    const uint8_t panelTile = gs.tiles.addType(res.panelTex, true);
+    const uint8_t grassTile = gs.tiles.addType(res.grassTex, false);
+    const uint8_t brickTile = gs.tiles.addType(res.brickTex, false);
+    gs.tileBody = GameObject();
+
+    const auto loadMap = [&](short layer[MAX_ROWS][MAX_COLS]){
         const auto createObj = [&state](SDL_Texture *tex, int r, int c, ObjectType type){
         GameObject obj;
         obj.type = type;
         obj.texture = tex;
         obj.pos = glm::vec2(c * TILE_SIZE, state.logH - (MAX_ROWS - r) * TILE_SIZE);
+        obj.prevPos = obj.pos;
         obj.hitbox = {
             .x = 0,
             .y = 0,
@@ -757,24 +1647,19 @@ void createTiles(const SDLState &state, GameState &gs, Resource &res){
             for(int c = 0; c < MAX_COLS; c++){
                 switch(layer[r][c]){
                     case 1:
-                        {
-                        GameObject ground = createObj(res.groundTex, r, c, ObjectType::level);
-                        gs.layers[LAYER_LEVEL_IDX].push_back(ground);
+                        gs.tiles.set(TileMap::LEVEL, r, c, groundTile);
                         break;
-                        }
                     case 2:
-                        {
-                        GameObject panel = createObj(res.panelTex, r, c, ObjectType::level);
-                        gs.layers[LAYER_LEVEL_IDX].push_back(panel);
+                        gs.tiles.set(TileMap::LEVEL, r, c, panelTile);
                         break;
-                        }
                     case 3:
                         {
                             GameObject enem = createObj(res.enemyTex, r, c, ObjectType::enemy);
                             enem.data.enemy = EnemyData();
                             enem.curAnimation = res.ENEMY_ANIMATION;
                             enem.animations = res.animationsEnemy;
-                            enem.dynamic = true;
+                            enem.body = BodyType::dynamicBody;
+                            enem.hasGravity = true;
                             enem.maxSpeedX = 15.0f;
                             enem.hitbox = SDL_FRect{
                                 .x = 10,
@@ -786,17 +1671,11 @@ void createTiles(const SDLState &state, GameState &gs, Resource &res){
                             break;
                         }
                     case 5:
-                        {
-                        GameObject grass = createObj(res.grassTex, r, c, ObjectType::level);
-                        gs.ForegroundTile.push_back(grass);
+                        gs.tiles.set(TileMap::FOREGROUND, r, c, grassTile);
                         break;
-                        }
                     case 6:
-                        {
-                        GameObject brick = createObj(res.brickTex, r, c, ObjectType::level);
-                        gs.BackgroundTile.push_back(brick);
+                        gs.tiles.set(TileMap::BACKGROUND, r, c, brickTile);
                         break;
-                        }
                     case 4:
                         {
                         GameObject player = createObj(res.idleTex, r, c, ObjectType::player);
@@ -805,7 +1684,8 @@ void createTiles(const SDLState &state, GameState &gs, Resource &res){
                         player.curAnimation = res.PLAYER_IDLE_ANIMATION;
                         player.maxSpeedX = 100;
                         player.acc = glm::vec2(300, 0);
-                        player.dynamic = true;
+                        player.body = BodyType::dynamicBody;
+                        player.hasGravity = true;
                         player.hitbox = {
                             .x = 11,
                             .y = 6,
@@ -824,6 +1704,20 @@ void createTiles(const SDLState &state, GameState &gs, Resource &res){
     loadMap(BackgroundMapData);
     loadMap(ForegroundMapData);
     assert(gs.playerIdx != -1);
+    gs.tiles.buildColliders();
+    gs.contacts.clear();
+    for(int i = 0; i < gs.layers[LAYER_CHARACTER_IDX].size(); i++){
+        GameObject &obj = gs.layers[LAYER_CHARACTER_IDX][i];
+        obj.handle = makeHandle(LAYER_CHARACTER_IDX, i);
+        gs.collisionRules.classify(obj);
+    }
+
+    gs.broadphase->clear();
+    for(int l = 0; l < gs.layers.size(); l++){
+        for(int i = 0; i < gs.layers[l].size(); i++){
+            gs.broadphase->insert(makeHandle(l, i), hitboxRect(gs.layers[l][i]));
+        }
+    }
 }
 
 void HandleKey(const SDLState &state, GameState &gs, GameObject &obj, SDL_Scancode key, bool pressed){
@@ -856,14 +1750,123 @@ void HandleKey(const SDLState &state, GameState &gs, GameObject &obj, SDL_Scanco
     }
 }
 
-void DrawParallaxBackground(SDL_Renderer *renderer, SDL_Texture *tex, float xVel, float &scrollPos, float scrollFact, float timeDelta){
+// Draws the tiles of one layer that reach map x range [x0, x1), with x0 at
+// the left edge of the current render target
+void DrawTileLayer(const SDLState &state, RenderState &rs, const Resource &res, const TileMap &tiles, int layer, float x0, float x1){
+    static const int drawLayers[TileMap::LAYER_COUNT] = {DRAW_BACKGROUND_TILES, DRAW_LEVEL_TILES, DRAW_FOREGROUND_TILES};
+    const float size = tiles.getTileSize();
+    const SDL_FRect from{0, 0, size, size};
+    const glm::vec2 origin = tiles.cellPos(0, 0);
+    const int c0 = SDL_max(static_cast<int>(std::floor(x0 / size)), 0);
+    const int c1 = SDL_min(static_cast<int>(std::ceil(x1 / size)), tiles.getCols()) - 1;
+    for(int r = 0; r < tiles.getRows(); r++){
+        for(int c = c0; c <= c1; c++){
+            const uint8_t id = tiles.get(layer, r, c);
+            if(!id) continue;
+            const glm::vec2 pos = tiles.cellPos(r, c) - origin;
+            SDL_FRect to{
+                .x = pos.x - x0,
+                .y = pos.y,
+                .w = size,
+                .h = size
+            };
+            SDL_Texture *tex = tiles.type(id).texture;
+            const AtlasEntry *sprite = res.atlas.find(tex);
+            if(sprite){
+                rs.batch.add(drawLayers[layer], res.atlas.page(sprite->page), res.atlas.frameRect(*sprite, 0, false), to);
+            }
+            else{
+                rs.batch.flush(state.renderer);
+                SDL_RenderTexture(state.renderer, tex, &from, &to);
+            }
+        }
+    }
+}
+
+// Tile layers don't change while playing, so they are drawn from cached
+// strips and the tiles themselves only get drawn when a strip is refreshed
+void DrawTileChunks(const SDLState &state, RenderState &rs, const Resource &res, const TileMap &tiles, TileChunks &chunks, int firstLayer, int lastLayer){
+    rs.batch.flush(state.renderer);
+    const glm::vec2 origin = tiles.cellPos(0, 0);
+    const glm::vec2 screenOrigin(origin.x - rs.MapViewport.x, origin.y);
+    chunks.draw(state.renderer, rs.MapViewport.x - origin.x, rs.MapViewport.w, screenOrigin, [&](float x0, float x1){
+        for(int layer = firstLayer; layer <= lastLayer; layer++){
+            DrawTileLayer(state, rs, res, tiles, layer, x0, x1);
+        }
+        rs.batch.flush(state.renderer);
+    });
+}
+
+void DrawColliders(const SDLState &state, RenderState &rs, const TileMap &tiles){
+    rs.batch.flush(state.renderer);
+    SDL_SetRenderDrawBlendMode(state.renderer, SDL_BLENDMODE_BLEND);
+    for(const SDL_FRect &collider : tiles.getColliders()){
+        SDL_FRect to{collider.x - rs.MapViewport.x, collider.y, collider.w, collider.h};
+        SDL_SetRenderDrawColor(state.renderer, 255, 0, 0, 150);
+        SDL_RenderFillRect(state.renderer, &to);
+        SDL_SetRenderDrawColor(state.renderer, 255, 255, 0, 255);
+        SDL_RenderRect(state.renderer, &to);
+    }
+    SDL_SetRenderDrawBlendMode(state.renderer, SDL_BLENDMODE_NONE);
+}
+
+// The HUD is kept as one mesh over the glyph atlas and only laid out again
+// when something on it changes, which for HP is rarely. The debug readouts
+// hold their last values until HUD_DEBUG_REFRESH_MS has passed.
+void DrawHud(const SDLState &state, RenderState &rs, const Resource &res, const RenderSnapshot &snap){
+    HudValues values = rs.hudShown;
+    values.hp = snap.hp;
+    values.hpMax = snap.hpMax;
+    values.debug = rs.debugMode;
+    const uint64_t now = SDL_GetTicksNS();
+    if(rs.debugMode && (!rs.hudShown.debug || now >= rs.hudDebugDue)){
+        rs.hudDebugDue = now + SDL_MS_TO_NS(HUD_DEBUG_REFRESH_MS);
+        values.playerState = snap.playerState;
+        values.bullets = snap.bullets;
+        values.grounded = snap.grounded;
+        values.idleBullets = snap.idleBullets;
+        values.bulletX = snap.bulletX;
+        values.viewX = snap.viewX;
+        values.drawn = rs.drawnCount;
+        values.culled = rs.culledCount;
+        values.vsync = state.vsync;
+        values.fpsCap = state.pacer.target();
+        values.frameMean = state.pacer.meanMs();
+        values.frameDeviation = state.pacer.deviationMs();
+        values.frameWorst = state.pacer.worstMs();
+    }
+    if(!rs.hudBuilt || values != rs.hudShown){
+        const SDL_FColor red{1.0f, 0.0f, 0.0f, 1.0f};
+        rs.hud.clear();
+        if(values.debug){
+            char stateText[64], cullText[64], frameText[64];
+            SDL_snprintf(stateText, sizeof(stateText), "S: %d B: %d Grnd: %d IB: %d Bx: %f MVx: %f", values.playerState, values.bullets, values.grounded, values.idleBullets, values.bulletX, values.viewX);
+            SDL_snprintf(cullText, sizeof(cullText), "Drawn: %d Culled: %d", values.drawn, values.culled);
+            rs.hud.text(res.glyphs, 5, 5, stateText, red);
+            SDL_snprintf(frameText, sizeof(frameText), "Frame %.2f sd %.2f max %.2f vsync %d cap %d", values.frameMean, values.frameDeviation, values.frameWorst, values.vsync, values.fpsCap);
+            rs.hud.text(res.glyphs, 5, 15, cullText, red);
+            rs.hud.text(res.glyphs, 5, 25, frameText, red);
+        }
+        const float percHP = glm::clamp(values.hp / values.hpMax, 0.0f, 1.0f);
+        char hpText[64];
+        SDL_snprintf(hpText, sizeof(hpText), "HP: %.0f / %.0f", values.hp, values.hpMax);
+        rs.hud.text(res.glyphs, state.logW - 200, 15, hpText, red);
+        SDL_FRect bg = {static_cast<float>(state.logW - 200), 25.0f, HP_BAR_WIDTH, HP_BAR_HEIGHT},
+        fg = {static_cast<float>(state.logW - 200), 25.0f, percHP*150, HP_BAR_HEIGHT},
+        brdr = {bg.x-1, bg.y-1, bg.w+2, bg.h+2};
+        rs.hud.fill(res.glyphs, bg, SDL_FColor{50 / 255.0f, 50 / 255.0f, 50 / 255.0f, 1.0f});
+        rs.hud.outline(res.glyphs, brdr, SDL_FColor{1.0f, 1.0f, 1.0f, 1.0f});
+        rs.hud.fill(res.glyphs, fg, SDL_FColor{1.0f - percHP, percHP, 0.0f, 1.0f});
+        rs.hudShown = values;
+        rs.hudBuilt = true;
+    }
+    rs.hud.draw(state.renderer, res.glyphs);
+}
+
+void DrawParallaxBackground(const SDLState &state, const ParallaxStrip &strip, float xVel, float &scrollPos, float scrollFact, float timeDelta){
     scrollPos -= xVel * scrollFact * timeDelta;
-    if(scrollPos <= -tex->w) scrollPos = 0;
-    SDL_FRect where{
-        .x = scrollPos,
-        .y = 30,
-        .w = tex->w * 2.0f,
-        .h = static_cast<float>(tex->h)
-    };
-    SDL_RenderTextureTiled(renderer, tex, nullptr, 1, &where);
+    // Wrapping both ways keeps the strip covering the screen whichever way
+    // the player runs
+    if(strip.width() > 0.0f) scrollPos = std::fmod(scrollPos, strip.width());
+    strip.draw(state.renderer, scrollPos, state.logW);
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <cmath>
+#include <cstdint>
+
+// A background layer composed once at load time into a texture that wraps
+// on itself, so it draws as one or two plain copies instead of being tiled
+// or scaled every frame.
+class ParallaxStrip{
+    SDL_Texture *texture;
+    float y;
+    bool opaque;
+public:
+    ParallaxStrip() : texture(nullptr), y(0.0f), opaque(false) {}
+
+    // Scaled to cover a viewW by viewH screen. Used for the back layer,
+    // which doesn't scroll.
+    bool buildFill(SDL_Renderer *renderer, SDL_Surface *image, int viewW, int viewH){
+        unload();
+        if(!image) return false;
+        SDL_Surface *strip = SDL_CreateSurface(viewW, viewH, SDL_PIXELFORMAT_RGBA32);
+        if(!strip) return false;
+        SDL_SetSurfaceBlendMode(image, SDL_BLENDMODE_NONE);
+        SDL_BlitSurfaceScaled(image, nullptr, strip, nullptr, SDL_SCALEMODE_NEAREST);
+        y = 0.0f;
+        return upload(renderer, strip);
+    }
+
+    // The image repeated side by side until the strip is at least viewW
+    // wide, drawn at its own size at height atY. A whole number of copies
+    // keeps the seam where the strip wraps invisible.
+    bool buildWrap(SDL_Renderer *renderer, SDL_Surface *image, int viewW, float atY){
+        unload();
+        if(!image || image->w <= 0) return false;
+        const int copies = SDL_max((viewW + image->w - 1) / image->w, 1);
+        SDL_Surface *strip = SDL_CreateSurface(image->w * copies, image->h, SDL_PIXELFORMAT_RGBA32);
+        if(!strip) return false;
+        SDL_SetSurfaceBlendMode(image, SDL_BLENDMODE_NONE);
+        for(int i = 0; i < copies; i++){
+            SDL_Rect to{i * image->w, 0, image->w, image->h};
+            SDL_BlitSurface(image, nullptr, strip, &to);
+        }
+        y = atY;
+        return upload(renderer, strip);
+    }
+
+    void unload(){
+        SDL_DestroyTexture(texture);
+        texture = nullptr;
+        opaque = false;
+    }
+
+    bool loaded() const { return texture != nullptr; }
+    // Whether it covers everything under it, so whatever is there needn't be drawn
+    bool isOpaque() const { return opaque; }
+    float width() const { return texture ? static_cast<float>(texture->w) : 0.0f; }
+
+    // Draws the strip with its left edge at scrollPos, wrapped so that one or
+    // two copies cover a viewW wide screen
+    void draw(SDL_Renderer *renderer, float scrollPos, float viewW) const {
+        if(!texture) return;
+        const float w = static_cast<float>(texture->w);
+        float x = std::fmod(scrollPos, w);
+        if(x > 0.0f) x -= w;
+        SDL_FRect where{x, y, w, static_cast<float>(texture->h)};
+        SDL_RenderTexture(renderer, texture, nullptr, &where);
+        if(x + w < viewW){
+            where.x += w;
+            SDL_RenderTexture(renderer, texture, nullptr, &where);
+        }
+    }
+private:
+    bool upload(SDL_Renderer *renderer, SDL_Surface *strip){
+        opaque = true;
+        for(int row = 0; row < strip->h && opaque; row++){
+            const uint32_t *pixel = reinterpret_cast<const uint32_t*>(static_cast<const Uint8*>(strip->pixels) + row * strip->pitch);
+            for(int col = 0; col < strip->w; col++){
+                if(reinterpret_cast<const Uint8*>(pixel + col)[3] != 255){
+                    opaque = false;
+                    break;
+                }
+            }
+        }
+        texture = SDL_CreateTextureFromSurface(renderer, strip);
+        SDL_DestroySurface(strip);
+        if(!texture){
+            opaque = false;
+            return false;
+        }
+        SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+        SDL_SetTextureBlendMode(texture, opaque ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+        return true;
+    }
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "broadphase.h"
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Uniform grid broadphase. Cheap to update and fine for most levels, as long
+// as bodies are about the size of a cell.
+class SpatialHash : public Broadphase{
+    struct CellRange{
+        int x0, y0, x1, y1;
+    };
+
+    float cellSize;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    std::unordered_map<uint32_t, SDL_FRect> bounds;
+
+    static uint64_t key(int cx, int cy){
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+    }
+    // Float rects touching on an edge still intersect, so a rect covers every
+    // cell whose closed extent it reaches.
+    CellRange range(const SDL_FRect &rect) const {
+        return CellRange{
+            .x0 = static_cast<int>(std::ceil(rect.x / cellSize)) - 1,
+            .y0 = static_cast<int>(std::ceil(rect.y / cellSize)) - 1,
+            .x1 = static_cast<int>(std::floor((rect.x + rect.w) / cellSize)),
+            .y1 = static_cast<int>(std::floor((rect.y + rect.h) / cellSize))
+        };
+    }
+    void link(uint32_t handle, const CellRange &r){
+        for(int cy = r.y0; cy <= r.y1; cy++){
+            for(int cx = r.x0; cx <= r.x1; cx++){
+                cells[key(cx, cy)].push_back(handle);
+            }
+        }
+    }
+    void unlink(uint32_t handle, const CellRange &r){
+        for(int cy = r.y0; cy <= r.y1; cy++){
+            for(int cx = r.x0; cx <= r.x1; cx++){
+                auto it = cells.find(key(cx, cy));
+                if(it == cells.end()) continue;
+                std::vector<uint32_t> &cell = it->second;
+                auto pos = std::find(cell.begin(), cell.end(), handle);
+                if(pos != cell.end()){
+                    *pos = cell.back();
+                    cell.pop_back();
+                }
+            }
+        }
+    }
+public:
+    SpatialHash(float cellSize) : cellSize(cellSize) {}
+
+    void clear() override {
+        cells.clear();
+        bounds.clear();
+    }
+
+    void insert(uint32_t handle, const SDL_FRect &rect) override {
+        if(bounds.count(handle)){
+            move(handle, rect);
+            return;
+        }
+        bounds[handle] = rect;
+        if(!emptyRect(rect)) link(handle, range(rect));
+    }
+
+    void remove(uint32_t handle) override {
+        auto it = bounds.find(handle);
+        if(it == bounds.end()) return;
+        if(!emptyRect(it->second)) unlink(handle, range(it->second));
+        bounds.erase(it);
+    }
+
+    // Only touches the cell lists when the covered range actually changes,
+    // which for walking characters is a few times per second.
+    void move(uint32_t handle, const SDL_FRect &rect) override {
+        auto it = bounds.find(handle);
+        if(it == bounds.end()){
+            insert(handle, rect);
+            return;
+        }
+        const SDL_FRect old = it->second;
+        it->second = rect;
+        const bool wasEmpty = emptyRect(old), isEmpty = emptyRect(rect);
+        if(wasEmpty && isEmpty) return;
+        if(!wasEmpty && !isEmpty){
+            CellRange from = range(old), to = range(rect);
+            if(from.x0 == to.x0 && from.y0 == to.y0 && from.x1 == to.x1 && from.y1 == to.y1) return;
+        }
+        if(!wasEmpty) unlink(handle, range(old));
+        if(!isEmpty) link(handle, range(rect));
+    }
+
+    void query(const SDL_FRect &rect, std::vector<uint32_t> &out) const override {
+        out.clear();
+        if(emptyRect(rect)) return;
+        CellRange r = range(rect);
+        for(int cy = r.y0; cy <= r.y1; cy++){
+            for(int cx = r.x0; cx <= r.x1; cx++){
+                auto it = cells.find(key(cx, cy));
+                if(it != cells.end()) out.insert(out.end(), it->second.begin(), it->second.end());
+            }
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <vector>
+#include <algorithm>
+
+// Collects textured quads over a frame and draws them with one
+// SDL_RenderGeometry call per texture and layer. Quads are drawn in layer
+// order; inside a layer the batch is free to group them by texture.
+class SpriteBatch{
+    struct Quad{
+        int layer;
+        SDL_Texture *texture;
+        SDL_FRect src, dst;
+        SDL_FColor color;
+    };
+
+    std::vector<Quad> quads;
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+
+public:
+    void add(int layer, SDL_Texture *texture, const SDL_FRect &src, const SDL_FRect &dst, SDL_FColor color = SDL_FColor{1.0f, 1.0f, 1.0f, 1.0f}){
+        quads.push_back(Quad{layer, texture, src, dst, color});
+    }
+
+    // Draws everything added so far. Anything drawn directly on the renderer
+    // in between has to flush first to keep its place in the order.
+    void flush(SDL_Renderer *renderer){
+        std::stable_sort(quads.begin(), quads.end(), [](const Quad &a, const Quad &b){
+            if(a.layer != b.layer) return a.layer < b.layer;
+            return a.texture < b.texture;
+        });
+        for(int first = 0; first < quads.size(); ){
+            int last = first;
+            while(last < quads.size() && quads[last].layer == quads[first].layer && quads[last].texture == quads[first].texture) last++;
+            SDL_Texture *tex = quads[first].texture;
+            const float texW = static_cast<float>(tex->w), texH = static_cast<float>(tex->h);
+            vertices.clear();
+            indices.clear();
+            for(int i = first; i < last; i++){
+                const Quad &q = quads[i];
+                const int base = static_cast<int>(vertices.size());
+                const float u0 = q.src.x / texW, v0 = q.src.y / texH;
+                const float u1 = (q.src.x + q.src.w) / texW, v1 = (q.src.y + q.src.h) / texH;
+                vertices.push_back(SDL_Vertex{{q.dst.x, q.dst.y}, q.color, {u0, v0}});
+                vertices.push_back(SDL_Vertex{{q.dst.x + q.dst.w, q.dst.y}, q.color, {u1, v0}});
+                vertices.push_back(SDL_Vertex{{q.dst.x + q.dst.w, q.dst.y + q.dst.h}, q.color, {u1, v1}});
+                vertices.push_back(SDL_Vertex{{q.dst.x, q.dst.y + q.dst.h}, q.color, {u0, v1}});
+                for(int corner : {0, 1, 2, 0, 2, 3}){
+                    indices.push_back(base + corner);
+                }
+            }
+            SDL_RenderGeometry(renderer, tex, vertices.data(), static_cast<int>(vertices.size()), indices.data(), static_cast<int>(indices.size()));
+            first = last;
+        }
+        quads.clear();
+    }
+};
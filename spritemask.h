@@ -0,0 +1,71 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// 1-bit alpha masks for a sprite sheet of square frames laid out in a row.
+// Every pixel row of a frame is one 64-bit word with bit x set where column x
+// is opaque, so two sprites are tested a row at a time with a shift and an
+// AND. Sheets with frames wider than 64 pixels get no mask.
+class SpriteMask{
+    int frameSize, frameCount;
+    std::vector<uint64_t> rows, flippedRows; // frameSize words per frame
+public:
+    static const Uint8 ALPHA_THRESHOLD = 128;
+
+    SpriteMask() : frameSize(0), frameCount(0) {}
+
+    void build(SDL_Surface *surface){
+        frameSize = frameCount = 0;
+        rows.clear();
+        flippedRows.clear();
+        if(!surface || surface->h <= 0 || surface->h > 64) return;
+        SDL_Surface *rgba = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_RGBA32);
+        if(!rgba) return;
+        frameSize = rgba->h;
+        frameCount = rgba->w / rgba->h;
+        rows.assign(frameCount * frameSize, 0);
+        flippedRows.assign(frameCount * frameSize, 0);
+        for(int f = 0; f < frameCount; f++){
+            for(int y = 0; y < frameSize; y++){
+                const Uint8 *pixel = static_cast<const Uint8*>(rgba->pixels) + y * rgba->pitch + f * frameSize * 4;
+                uint64_t bits = 0, flipped = 0;
+                for(int x = 0; x < frameSize; x++){
+                    if(pixel[x * 4 + 3] >= ALPHA_THRESHOLD){
+                        bits |= 1ull << x;
+                        flipped |= 1ull << (frameSize - 1 - x);
+                    }
+                }
+                rows[f * frameSize + y] = bits;
+                flippedRows[f * frameSize + y] = flipped;
+            }
+        }
+        SDL_DestroySurface(rgba);
+    }
+
+    bool empty() const { return frameCount == 0; }
+    int size() const { return frameSize; }
+
+    // Rows of one frame as it is drawn, mirrored for sprites facing left
+    const uint64_t *frame(int idx, bool flipped) const {
+        idx = SDL_clamp(idx, 0, frameCount - 1);
+        return (flipped ? flippedRows : rows).data() + idx * frameSize;
+    }
+};
+
+// Whether any opaque pixels of two frames overlap, with their top-left
+// corners at posA and posB
+inline bool masksOverlap(const uint64_t *a, int sizeA, glm::ivec2 posA, const uint64_t *b, int sizeB, glm::ivec2 posB){
+    const glm::ivec2 d = posB - posA;
+    if(d.x >= sizeA || -d.x >= sizeB) return false;
+    const int y0 = std::max(d.y, 0), y1 = std::min(sizeA, d.y + sizeB);
+    for(int y = y0; y < y1; y++){
+        const uint64_t rowB = b[y - d.y];
+        const uint64_t shifted = d.x >= 0 ? rowB << d.x : rowB >> -d.x;
+        if(a[y] & shifted) return true;
+    }
+    return false;
+}
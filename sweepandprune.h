@@ -0,0 +1,107 @@
+#pragma once
+
+#include "broadphase.h"
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// Bodies kept sorted by their left edge. Characters only shuffle a slot or two
+// per tick, so an insertion-sort step keeps the order cheap to maintain, and
+// a query only scans the slice of the list that can reach it on x. Best for
+// long levels where bodies are spread out along one axis.
+class SweepAndPrune : public Broadphase{
+    struct Entry{
+        SDL_FRect rect;
+        uint32_t handle;
+    };
+
+    std::vector<Entry> entries;
+    std::unordered_map<uint32_t, int> slots; // position in entries, -1 while the rect is empty
+    float maxWidth; // widest rect seen since the last clear
+
+    void resort(int i){
+        while(i > 0 && entries[i - 1].rect.x > entries[i].rect.x){
+            std::swap(entries[i - 1], entries[i]);
+            slots[entries[i].handle] = i;
+            i--;
+        }
+        while(i + 1 < entries.size() && entries[i + 1].rect.x < entries[i].rect.x){
+            std::swap(entries[i + 1], entries[i]);
+            slots[entries[i].handle] = i;
+            i++;
+        }
+        slots[entries[i].handle] = i;
+    }
+    void add(uint32_t handle, const SDL_FRect &rect){
+        entries.push_back(Entry{rect, handle});
+        maxWidth = std::max(maxWidth, rect.w);
+        resort(static_cast<int>(entries.size()) - 1);
+    }
+    void erase(int i){
+        entries.erase(entries.begin() + i);
+        for(int j = i; j < entries.size(); j++){
+            slots[entries[j].handle] = j;
+        }
+    }
+public:
+    SweepAndPrune() : maxWidth(0.0f) {}
+
+    void clear() override {
+        entries.clear();
+        slots.clear();
+        maxWidth = 0.0f;
+    }
+
+    void insert(uint32_t handle, const SDL_FRect &rect) override {
+        if(slots.count(handle)){
+            move(handle, rect);
+            return;
+        }
+        slots[handle] = -1;
+        if(!emptyRect(rect)) add(handle, rect);
+    }
+
+    void remove(uint32_t handle) override {
+        auto it = slots.find(handle);
+        if(it == slots.end()) return;
+        const int i = it->second;
+        slots.erase(it);
+        if(i != -1) erase(i);
+    }
+
+    void move(uint32_t handle, const SDL_FRect &rect) override {
+        auto it = slots.find(handle);
+        if(it == slots.end()){
+            insert(handle, rect);
+            return;
+        }
+        const int i = it->second;
+        if(i == -1){
+            if(!emptyRect(rect)) add(handle, rect);
+        }
+        else if(emptyRect(rect)){
+            it->second = -1;
+            erase(i);
+        }
+        else{
+            entries[i].rect = rect;
+            maxWidth = std::max(maxWidth, rect.w);
+            resort(i);
+        }
+    }
+
+    void query(const SDL_FRect &rect, std::vector<uint32_t> &out) const override {
+        out.clear();
+        if(emptyRect(rect)) return;
+        // Nothing that starts further left than the widest body can reach rect
+        const float from = rect.x - maxWidth, to = rect.x + rect.w;
+        auto it = std::lower_bound(entries.begin(), entries.end(), from, [](const Entry &e, float x){
+            return e.rect.x < x;
+        });
+        for(; it != entries.end() && it->rect.x <= to; ++it){
+            if(rectsTouch(it->rect, rect)) out.push_back(it->handle);
+        }
+        std::sort(out.begin(), out.end());
+    }
+};
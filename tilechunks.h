@@ -0,0 +1,92 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+
+// Static tiles pre-rendered into fixed-width strips. A frame only draws the
+// two or three strips under the viewport, and a strip is only rendered again
+// after its tiles change or the renderer loses its render targets.
+class TileChunks{
+public:
+    static const int CHUNK_WIDTH = 512;
+private:
+    struct Chunk{
+        SDL_Texture *texture;
+        bool dirty;
+    };
+
+    std::vector<Chunk> chunks;
+    float height;
+
+    int chunkAt(float x) const {
+        return static_cast<int>(std::floor(x / CHUNK_WIDTH));
+    }
+public:
+    TileChunks() : height(0.0f) {}
+
+    // Sizes the strips for a map width by height pixels, all dirty
+    void reset(float width, float mapHeight){
+        unload();
+        height = mapHeight;
+        chunks.assign(static_cast<int>(std::ceil(width / CHUNK_WIDTH)), Chunk{nullptr, true});
+    }
+
+    void unload(){
+        for(Chunk &chunk : chunks){
+            SDL_DestroyTexture(chunk.texture);
+        }
+        chunks.clear();
+    }
+
+    // Marks the strips covering map x range [x0, x1) for redrawing
+    void invalidate(float x0, float x1){
+        const int first = SDL_max(chunkAt(x0), 0);
+        const int last = SDL_min(chunkAt(x1 - 1.0f), static_cast<int>(chunks.size()) - 1);
+        for(int i = first; i <= last; i++){
+            chunks[i].dirty = true;
+        }
+    }
+    void invalidateAll(){
+        for(Chunk &chunk : chunks){
+            chunk.dirty = true;
+        }
+    }
+
+    // Draws the strips reaching the view, map x range [viewX, viewX + viewW),
+    // with the map origin at screen position origin. Dirty strips are first
+    // redrawn through render(x0, x1) with the strip as render target,
+    // cleared, and map x range [x0, x1) mapped to its left edge.
+    template<typename F>
+    void draw(SDL_Renderer *renderer, float viewX, float viewW, glm::vec2 origin, F render){
+        const int first = SDL_max(chunkAt(viewX), 0);
+        const int last = SDL_min(chunkAt(viewX + viewW), static_cast<int>(chunks.size()) - 1);
+        for(int i = first; i <= last; i++){
+            Chunk &chunk = chunks[i];
+            if(!chunk.texture){
+                chunk.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, CHUNK_WIDTH, static_cast<int>(height));
+                if(!chunk.texture) continue;
+                SDL_SetTextureBlendMode(chunk.texture, SDL_BLENDMODE_BLEND);
+                SDL_SetTextureScaleMode(chunk.texture, SDL_SCALEMODE_NEAREST);
+                chunk.dirty = true;
+            }
+            if(chunk.dirty){
+                SDL_Texture *screen = SDL_GetRenderTarget(renderer);
+                SDL_SetRenderTarget(renderer, chunk.texture);
+                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+                SDL_RenderClear(renderer);
+                render(static_cast<float>(i * CHUNK_WIDTH), static_cast<float>((i + 1) * CHUNK_WIDTH));
+                SDL_SetRenderTarget(renderer, screen);
+                chunk.dirty = false;
+            }
+            const SDL_FRect to{
+                .x = origin.x + i * CHUNK_WIDTH,
+                .y = origin.y,
+                .w = static_cast<float>(CHUNK_WIDTH),
+                .h = height
+            };
+            SDL_RenderTexture(renderer, chunk.texture, nullptr, &to);
+        }
+    }
+};
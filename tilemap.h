@@ -0,0 +1,267 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+struct TileType{
+    SDL_Texture *texture;
+    bool solid;
+};
+
+// Dense per-layer grid of one-byte tile ids. Id 0 is always the empty tile,
+// everything else indexes the shared tile type table.
+class TileMap{
+public:
+    static const int BACKGROUND = 0;
+    static const int LEVEL = 1;
+    static const int FOREGROUND = 2;
+    static const int LAYER_COUNT = 3;
+private:
+    int rows, cols;
+    float tileSize;
+    glm::vec2 origin;
+    std::vector<TileType> types;
+    std::array<std::vector<uint8_t>, LAYER_COUNT> layers;
+    // One bit per column for the solid tiles of the level layer, rowWords
+    // 64-bit words per row
+    std::vector<uint64_t> solidRows;
+    int rowWords;
+    // Solid level cells merged into as few rectangles as possible, and for
+    // every cell the collider covering it (0 for none, otherwise index + 1)
+    std::vector<SDL_FRect> colliders;
+    std::vector<uint16_t> colliderAt;
+    bool collidersDirty;
+    uint32_t levelVersion; // bumped whenever the level layer changes
+    // Columns changed on any layer since the last takeChanges(), none while
+    // changedC0 > changedC1
+    int changedC0, changedC1;
+
+    static uint64_t spanMask(int lo, int hi){
+        return (~0ull >> (63 - hi)) & (~0ull << lo);
+    }
+    // Calls fn(row, word, bits) for each word of the solid rows covered by the
+    // given (already clamped) cell range
+    template<typename F>
+    void scanRows(int r0, int c0, int r1, int c1, F fn) const {
+        for(int r = r0; r <= r1; r++){
+            for(int w = c0 / 64; w <= c1 / 64; w++){
+                const int lo = SDL_max(c0, w * 64) - w * 64;
+                const int hi = SDL_min(c1, w * 64 + 63) - w * 64;
+                const uint64_t bits = solidRows[r * rowWords + w] & spanMask(lo, hi);
+                if(bits && fn(r, w, bits)) return;
+            }
+        }
+    }
+public:
+    TileMap() : rows(0), cols(0), tileSize(0.0f), origin(0), rowWords(0), collidersDirty(false), levelVersion(0), changedC0(0), changedC1(-1) {
+        types.push_back(TileType{nullptr, false});
+    }
+
+    void reset(int rowCount, int colCount, float size, glm::vec2 mapOrigin){
+        rows = rowCount;
+        cols = colCount;
+        tileSize = size;
+        origin = mapOrigin;
+        types.resize(1);
+        for(auto &layer : layers){
+            layer.assign(rows * cols, 0);
+        }
+        rowWords = (cols + 63) / 64;
+        solidRows.assign(rows * rowWords, 0);
+        colliders.clear();
+        colliderAt.assign(rows * cols, 0);
+        collidersDirty = true;
+        levelVersion++;
+        changedC0 = 0;
+        changedC1 = cols - 1;
+    }
+
+    uint8_t addType(SDL_Texture *tex, bool solid){
+        types.push_back(TileType{tex, solid});
+        return static_cast<uint8_t>(types.size() - 1);
+    }
+
+    void set(int layer, int r, int c, uint8_t id){
+        layers[layer][r * cols + c] = id;
+        changedC0 = SDL_min(changedC0, c);
+        changedC1 = SDL_max(changedC1, c);
+        if(layer != LEVEL) return;
+        uint64_t &word = solidRows[r * rowWords + c / 64];
+        if(types[id].solid) word |= 1ull << (c % 64);
+        else word &= ~(1ull << (c % 64));
+        collidersDirty = true;
+        levelVersion++;
+    }
+    uint8_t get(int layer, int r, int c) const { return layers[layer][r * cols + c]; }
+    const TileType &type(uint8_t id) const { return types[id]; }
+    bool solid(int layer, int r, int c) const { return types[get(layer, r, c)].solid; }
+
+    // Range of columns changed since the last call, for caches of the drawn
+    // tiles. Returns false when nothing changed.
+    bool takeChanges(int &c0, int &c1){
+        if(changedC0 > changedC1) return false;
+        c0 = changedC0;
+        c1 = changedC1;
+        changedC0 = cols;
+        changedC1 = -1;
+        return true;
+    }
+
+    // Changes whenever a level tile does, for caches of what touches them
+    uint32_t getLevelVersion() const { return levelVersion; }
+
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+    float getTileSize() const { return tileSize; }
+
+    glm::vec2 cellPos(int r, int c) const {
+        return origin + glm::vec2(c * tileSize, r * tileSize);
+    }
+
+    // Every cell whose closed extent rect reaches, clamped to the map.
+    // Returns false when rect lies entirely off the grid.
+    bool cellRange(const SDL_FRect &rect, int &r0, int &c0, int &r1, int &c1) const {
+        if(rect.w < 0.0f || rect.h < 0.0f) return false;
+        c0 = SDL_max(static_cast<int>(std::ceil((rect.x - origin.x) / tileSize)) - 1, 0);
+        r0 = SDL_max(static_cast<int>(std::ceil((rect.y - origin.y) / tileSize)) - 1, 0);
+        c1 = SDL_min(static_cast<int>(std::floor((rect.x + rect.w - origin.x) / tileSize)), cols - 1);
+        r1 = SDL_min(static_cast<int>(std::floor((rect.y + rect.h - origin.y) / tileSize)), rows - 1);
+        return r0 <= r1 && c0 <= c1;
+    }
+
+    // Ground probe rule: true if a solid level tile overlaps sensor further
+    // across than down. A tile only grazed at the side of the sensor doesn't
+    // hold a body up, and one just touching its bottom edge does.
+    bool anyGround(const SDL_FRect &sensor) const {
+        bool hit = false;
+        forEachSolid(sensor, [&](int r, int c){
+            const glm::vec2 pos = cellPos(r, c);
+            const float w = SDL_min(sensor.x + sensor.w, pos.x + tileSize) - SDL_max(sensor.x, pos.x);
+            const float h = SDL_min(sensor.y + sensor.h, pos.y + tileSize) - SDL_max(sensor.y, pos.y);
+            if(w >= 0.0f && h >= 0.0f && h < w) hit = true;
+        });
+        return hit;
+    }
+
+    // Greedy rectangle cover of the solid level cells: take the first free
+    // cell in row-major order, run right as far as the row allows, then grow
+    // down while every cell of that span is still free and solid.
+    void buildColliders(){
+        colliders.clear();
+        colliderAt.assign(rows * cols, 0);
+        for(int r = 0; r < rows; r++){
+            for(int c = 0; c < cols; c++){
+                if(!solid(LEVEL, r, c) || colliderAt[r * cols + c]) continue;
+                int w = 1, h = 1;
+                while(c + w < cols && solid(LEVEL, r, c + w) && !colliderAt[r * cols + c + w]) w++;
+                for(bool grow = true; grow && r + h < rows; ){
+                    for(int i = c; i < c + w && grow; i++){
+                        grow = solid(LEVEL, r + h, i) && !colliderAt[(r + h) * cols + i];
+                    }
+                    if(grow) h++;
+                }
+                colliders.push_back(SDL_FRect{
+                    .x = origin.x + c * tileSize,
+                    .y = origin.y + r * tileSize,
+                    .w = w * tileSize,
+                    .h = h * tileSize
+                });
+                const uint16_t id = static_cast<uint16_t>(colliders.size());
+                for(int y = r; y < r + h; y++){
+                    for(int x = c; x < c + w; x++){
+                        colliderAt[y * cols + x] = id;
+                    }
+                }
+            }
+        }
+        collidersDirty = false;
+    }
+
+    const std::vector<SDL_FRect> &getColliders(){
+        if(collidersDirty) buildColliders();
+        return colliders;
+    }
+    // As last built, for read-only copies of the map
+    const std::vector<SDL_FRect> &getColliders() const { return colliders; }
+
+    // Calls fn(rect, idx) for every merged collider with a cell reaching
+    // rect, once each, in the order they were built.
+    template<typename F>
+    void forEachCollider(const SDL_FRect &rect, F fn){
+        if(collidersDirty) buildColliders();
+        static thread_local std::vector<uint16_t> found;
+        found.clear();
+        forEachSolid(rect, [this](int r, int c){ found.push_back(colliderAt[r * cols + c]); });
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+        for(uint16_t id : found){
+            fn(colliders[id - 1], id - 1);
+        }
+    }
+
+    // First solid level tile along origin + dir * t for 0 <= t <= maxDist,
+    // with dir normalised. Steps from cell to cell along the ray (Amanatides
+    // & Woo), so the cost is the number of cells crossed, not the map size.
+    // A ray starting inside a solid tile hits at 0 with a zero normal.
+    bool raycast(glm::vec2 from, glm::vec2 dir, float maxDist, float &dist, glm::vec2 &normal) const {
+        const float inf = std::numeric_limits<float>::infinity();
+        const glm::vec2 p = (from - origin) / tileSize;
+        int c = static_cast<int>(std::floor(p.x)), r = static_cast<int>(std::floor(p.y));
+        const int stepC = (dir.x > 0.0f) - (dir.x < 0.0f), stepR = (dir.y > 0.0f) - (dir.y < 0.0f);
+        // Distance along the ray to the next column/row boundary, and between two of them
+        float nextC = inf, nextR = inf, deltaC = inf, deltaR = inf;
+        if(stepC){
+            deltaC = tileSize / std::abs(dir.x);
+            nextC = (stepC > 0 ? c + 1 - p.x : p.x - c) * deltaC;
+        }
+        if(stepR){
+            deltaR = tileSize / std::abs(dir.y);
+            nextR = (stepR > 0 ? r + 1 - p.y : p.y - r) * deltaR;
+        }
+        float t = 0.0f;
+        normal = glm::vec2(0);
+        while(t <= maxDist){
+            if(r >= 0 && r < rows && c >= 0 && c < cols && solid(LEVEL, r, c)){
+                dist = t;
+                return true;
+            }
+            // Off the map and heading further away
+            if((c < 0 && stepC <= 0) || (c >= cols && stepC >= 0) || (r < 0 && stepR <= 0) || (r >= rows && stepR >= 0)) return false;
+            if(nextC < nextR){
+                t = nextC;
+                nextC += deltaC;
+                c += stepC;
+                normal = glm::vec2(-stepC, 0);
+            }
+            else{
+                t = nextR;
+                nextR += deltaR;
+                r += stepR;
+                normal = glm::vec2(0, -stepR);
+            }
+        }
+        return false;
+    }
+
+    // Calls fn(r, c) for every solid level tile reaching rect, in row-major
+    // order, skipping empty cells a word at a time.
+    template<typename F>
+    void forEachSolid(const SDL_FRect &rect, F fn) const {
+        int r0, c0, r1, c1;
+        if(!cellRange(rect, r0, c0, r1, c1)) return;
+        scanRows(r0, c0, r1, c1, [&fn](int r, int w, uint64_t bits){
+            while(bits){
+                fn(r, w * 64 + std::countr_zero(bits));
+                bits &= bits - 1;
+            }
+            return false;
+        });
+    }
+};
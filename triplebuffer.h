@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+
+// Hands values from one writer thread to one reader thread without either
+// waiting on the other. The writer fills its own buffer and publishes it by
+// swapping it with the middle one; the reader swaps the middle one in when
+// something new was published. Each side always owns one whole buffer.
+template<typename T>
+class TripleBuffer{
+    static const int FRESH = 4; // set on middle while it holds an unread value
+    T buffers[3];
+    std::atomic<int> middle;
+    int back, front;
+public:
+    TripleBuffer() : middle(1), back(0), front(2) {}
+
+    // Writer side
+    T &writeBuffer(){ return buffers[back]; }
+    void publish(){
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+    }
+
+    // Reader side. Takes the latest published value, if there is a new one,
+    // and returns whether it did.
+    bool acquire(){
+        if(!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+    const T &readBuffer() const { return buffers[front]; }
+};